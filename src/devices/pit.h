@@ -3,6 +3,14 @@
 
 #include <stdint.h>
 
+/* PIT cycles per second. */
+#define PIT_HZ 1193180
+
+/* Largest count the PIT can be loaded with. */
+#define PIT_COUNT_MAX 0xffff
+
 void pit_configure_channel (int channel, int mode, int frequency);
+void pit_configure_oneshot (int channel, uint16_t count);
+uint16_t pit_read_count (int channel);
 
 #endif /* devices/pit.h */
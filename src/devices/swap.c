@@ -1,10 +1,33 @@
 #include "devices/swap.h"
 #include "devices/block.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <list.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+
+/* Swap cache.
+
+   Pages written to swap are first offered to a pool of compressed
+   pages in kernel memory.  A page filled with one repeated word,
+   such as an untouched BSS page, is kept as just that word; any
+   other page is compressed with a small LZ77 coder and kept if it
+   shrinks to CACHE_MAX_PAGE_BYTES or less, so that its entry fits
+   in one of malloc()'s block sizes rather than taking a whole
+   page.  Only pages that do not compress go straight to the swap
+   device.  When the pool holds CACHE_LIMIT bytes of malloc()
+   blocks the oldest pages in it are written
+   back to their slots on the device to make room.  Every cached
+   page keeps its swap slot, so callers never know the difference.
+
+   cache_lock guards the pool, the scratch buffers and the
+   counters.  A page is found in or missing from the pool under
+   the lock, and only the page's owner writes its slot, so a page
+   found missing can be read from the device after releasing it. */
 
 /* Pointer to the swap device */
 static struct block *swap_device;
@@ -18,6 +41,60 @@ static struct lock swap_lock;
 /* Number of sectors needed to store a page */
 #define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
 
+/* Most bytes of kernel memory the swap cache may hold */
+#define CACHE_LIMIT (128 * 1024)
+
+/* Largest block malloc() carves from an arena; anything bigger
+   takes whole pages */
+#define CACHE_ENTRY_MAX (PGSIZE / 4)
+
+/* A page held in the swap cache */
+struct cache_entry
+  {
+    size_t slot;                /* Swap-slot the page belongs in */
+    size_t size;                /* Bytes in DATA, or 0 if FILL fills it */
+    uint32_t fill;              /* Word repeated through the page */
+    struct list_elem elem;      /* Element in cache_pages */
+    uint8_t data[];             /* Compressed page */
+  };
+
+/* Largest compressed page worth keeping in the swap cache */
+#define CACHE_MAX_PAGE_BYTES (CACHE_ENTRY_MAX - sizeof (struct cache_entry))
+
+/* Cached page for each swap-slot, or a null pointer */
+static struct cache_entry **cache_slots;
+
+/* Cached pages, oldest first */
+static struct list cache_pages;
+
+/* Bytes of kernel memory held by the cache */
+static size_t cache_used;
+
+/* Lock that protects the swap cache */
+static struct lock cache_lock;
+
+/* Scratch space for compressing and writing back pages */
+static uint8_t compress_buffer[CACHE_MAX_PAGE_BYTES];
+static uint8_t writeback_buffer[PGSIZE];
+
+/* Pages read back from the cache and from the swap device, and
+   cached pages written back to the swap device */
+static unsigned long long cache_hits;
+static unsigned long long cache_misses;
+static unsigned long long cache_writebacks;
+
+static bool cache_store (size_t slot, const void *page);
+static size_t cache_entry_bytes (size_t size);
+static bool cache_load (size_t slot, void *page);
+static void cache_decompress (const struct cache_entry *, void *page);
+static void cache_remove (struct cache_entry *);
+static void cache_writeback (void);
+static void swap_write_device (size_t slot, const void *const pages[],
+                               size_t cnt);
+static void swap_read_device (size_t slot, void *const pages[], size_t cnt);
+static size_t lz_compress (const uint8_t *src, uint8_t *dst, size_t limit);
+static void lz_decompress (const uint8_t *src, size_t size, uint8_t *dst);
+
 /* Sets up the swap space */
 void
 swap_init (void) 
@@ -36,6 +113,84 @@ swap_init (void)
     PANIC ("couldn't create swap bitmap");
   }
   lock_init (&swap_lock);
+
+  // one (initially empty) swap cache entry per swap-slot, plus one
+  // so that the table is never empty, as malloc() cannot return that
+  cache_slots = calloc (bitmap_size (swap_bitmap) + 1, sizeof *cache_slots);
+  if (cache_slots == NULL)
+    PANIC ("couldn't create swap cache");
+  list_init (&cache_pages);
+  lock_init (&cache_lock);
+}
+
+/* Reserves CNT consecutive swap-slots, returns the first of them,
+   or BITMAP_ERROR if swap has no run that long free */
+size_t
+swap_alloc (size_t cnt)
+{
+  lock_acquire (&swap_lock);
+  size_t slot = bitmap_scan_and_flip (swap_bitmap, 0, cnt, false);
+  lock_release (&swap_lock);
+  return slot;
+}
+
+/* Writes the CNT pages at PAGES into the swap-slots starting at SLOT,
+   reserved by swap_alloc(), page I into slot SLOT + I.  Pages are kept
+   compressed in the swap cache if they fit, and the rest are written to
+   the swap device a run of consecutive slots at a time */
+void
+swap_write (size_t slot, const void *const pages[], size_t cnt)
+{
+  // number of pages before page I that are still to be written out
+  size_t run = 0;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  for (size_t i = 0; i < cnt; i++)
+    {
+      lock_acquire (&cache_lock);
+      bool cached = cache_store (slot + i, pages[i]);
+      lock_release (&cache_lock);
+
+      if (cached)
+        {
+          swap_write_device (slot + i - run, pages + i - run, run);
+          run = 0;
+        }
+      else
+        run++;
+    }
+  swap_write_device (slot + cnt - run, pages + cnt - run, run);
+}
+
+/* Reads the CNT pages in the swap-slots starting at SLOT into memory,
+   slot SLOT + I into PAGES[I].  Pages in the swap cache are
+   decompressed, and the rest are read from the swap device a run of
+   consecutive slots at a time.  The slots stay reserved until
+   dropped */
+void
+swap_read (size_t slot, void *const pages[], size_t cnt)
+{
+  // number of pages before page I that are still to be read in
+  size_t run = 0;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  for (size_t i = 0; i < cnt; i++)
+    {
+      lock_acquire (&cache_lock);
+      bool cached = cache_load (slot + i, pages[i]);
+      lock_release (&cache_lock);
+
+      if (cached)
+        {
+          swap_read_device (slot + i - run, pages + i - run, run);
+          run = 0;
+        }
+      else
+        run++;
+    }
+  swap_read_device (slot + cnt - run, pages + cnt - run, run);
 }
 
 /* Swaps page at VADDR out of memory, returns the swap-slot used */
@@ -43,19 +198,11 @@ size_t
 swap_out (const void *vaddr) 
 {
   // find available swap-slot for the page to be swapped out
-  lock_acquire (&swap_lock);
-  size_t slot = bitmap_scan_and_flip (swap_bitmap, 0, 1, false);
-  lock_release (&swap_lock);
+  size_t slot = swap_alloc (1);
   if (slot == BITMAP_ERROR) 
     return BITMAP_ERROR; 
 
-  // calculate block sector from swap-slot number
-  size_t sector = slot * PAGE_SECTORS;
-  
-  // loop over each sector of the page, copying it from memory into swap
-  for (size_t i = 0; i < PAGE_SECTORS; i++)
-    block_write (swap_device, sector + i, vaddr + i * BLOCK_SECTOR_SIZE);
-
+  swap_write (slot, &vaddr, 1);
   return slot;
 }
 
@@ -63,12 +210,7 @@ swap_out (const void *vaddr)
 void
 swap_in (void *vaddr, size_t slot) 
 {
-  // calculate block sector from swap-slot number
-  size_t sector = slot * PAGE_SECTORS;
-
-  // loop over each sector of the page, copying it from swap into memory
-  for (size_t i = 0; i < PAGE_SECTORS; i++)
-    block_read (swap_device, sector + i, vaddr + i * BLOCK_SECTOR_SIZE);
+  swap_read (slot, &vaddr, 1);
   
   // clear the swap-slot previously used by this page
   swap_drop (slot);
@@ -78,5 +220,297 @@ swap_in (void *vaddr, size_t slot)
 void
 swap_drop (size_t slot)
 {
+  // forget any copy of the page in the swap cache
+  lock_acquire (&cache_lock);
+  if (cache_slots[slot] != NULL)
+    cache_remove (cache_slots[slot]);
+  lock_release (&cache_lock);
+
+  lock_acquire (&swap_lock);
   bitmap_reset (swap_bitmap, slot);
+  lock_release (&swap_lock);
+}
+
+/* Prints statistics for the swap cache */
+void
+swap_print_stats (void)
+{
+  printf ("Swap cache: %llu hits, %llu misses, %llu writebacks, "
+          "%zu bytes in use\n",
+          cache_hits, cache_misses, cache_writebacks, cache_used);
+}
+
+/* Writes the CNT pages at PAGES to the swap device, page I into
+   swap-slot SLOT + I, with a single request */
+static void
+swap_write_device (size_t slot, const void *const pages[], size_t cnt)
+{
+  const void *sectors[SWAP_CLUSTER * PAGE_SECTORS];
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  // gather the sectors of every page, in order on disk
+  for (size_t i = 0; i < cnt * PAGE_SECTORS; i++)
+    sectors[i] = pages[i / PAGE_SECTORS]
+                 + (i % PAGE_SECTORS) * BLOCK_SECTOR_SIZE;
+  block_write_multiple (swap_device, slot * PAGE_SECTORS,
+                        cnt * PAGE_SECTORS, sectors);
+}
+
+/* Reads the CNT pages in swap-slots SLOT onwards from the swap device,
+   slot SLOT + I into PAGES[I], with a single request */
+static void
+swap_read_device (size_t slot, void *const pages[], size_t cnt)
+{
+  void *sectors[SWAP_CLUSTER * PAGE_SECTORS];
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  // scatter the sectors on disk across the pages
+  for (size_t i = 0; i < cnt * PAGE_SECTORS; i++)
+    sectors[i] = pages[i / PAGE_SECTORS]
+                 + (i % PAGE_SECTORS) * BLOCK_SECTOR_SIZE;
+  block_read_multiple (swap_device, slot * PAGE_SECTORS,
+                       cnt * PAGE_SECTORS, sectors);
+}
+
+/* Keeps PAGE, bound for swap-slot SLOT, in the swap cache, writing
+   the oldest cached pages back to the swap device if that is needed to
+   make room.  Returns false if PAGE does not compress well or kernel
+   memory is short.  cache_lock must be held */
+static bool
+cache_store (size_t slot, const void *page)
+{
+  const uint32_t *words = page;
+  size_t word_cnt = PGSIZE / sizeof *words;
+  size_t size = 0;
+  size_t i;
+
+  ASSERT (cache_slots[slot] == NULL);
+
+  // a page of one repeated word needs only that word; otherwise compress
+  for (i = 1; i < word_cnt; i++)
+    if (words[i] != words[0])
+      break;
+  if (i < word_cnt)
+    {
+      size = lz_compress (page, compress_buffer, CACHE_MAX_PAGE_BYTES);
+      if (size == 0)
+        return false;
+    }
+
+  // make room by writing back the oldest pages
+  size_t need = cache_entry_bytes (size);
+  while (cache_used + need > CACHE_LIMIT && !list_empty (&cache_pages))
+    cache_writeback ();
+
+  struct cache_entry *e = malloc (sizeof *e + size);
+  if (e == NULL)
+    return false;
+  e->slot = slot;
+  e->size = size;
+  e->fill = words[0];
+  memcpy (e->data, compress_buffer, size);
+  list_push_back (&cache_pages, &e->elem);
+  cache_slots[slot] = e;
+  cache_used += need;
+  return true;
+}
+
+/* Returns the bytes of kernel memory taken by a cache entry holding
+   SIZE bytes of compressed data: the malloc() block it lands in,
+   whose sizes are the powers of 2 from 16 up to CACHE_ENTRY_MAX */
+static size_t
+cache_entry_bytes (size_t size)
+{
+  size_t need = sizeof (struct cache_entry) + size;
+  size_t bytes = 16;
+
+  ASSERT (need <= CACHE_ENTRY_MAX);
+  while (bytes < need)
+    bytes *= 2;
+  return bytes;
+}
+
+/* Reads the page for swap-slot SLOT from the swap cache into PAGE, if
+   it is there.  The page stays cached until its slot is dropped.
+   Returns false if the page is not in the cache.  cache_lock must be
+   held */
+static bool
+cache_load (size_t slot, void *page)
+{
+  struct cache_entry *e = cache_slots[slot];
+
+  if (e == NULL)
+    {
+      cache_misses++;
+      return false;
+    }
+  cache_decompress (e, page);
+  cache_hits++;
+  return true;
+}
+
+/* Restores the page held by cache entry E into PAGE */
+static void
+cache_decompress (const struct cache_entry *e, void *page)
+{
+  if (e->size == 0)
+    {
+      uint32_t *words = page;
+      for (size_t i = 0; i < PGSIZE / sizeof *words; i++)
+        words[i] = e->fill;
+    }
+  else
+    lz_decompress (e->data, e->size, page);
+}
+
+/* Removes E from the swap cache and frees it.  cache_lock must be
+   held */
+static void
+cache_remove (struct cache_entry *e)
+{
+  list_remove (&e->elem);
+  cache_slots[e->slot] = NULL;
+  cache_used -= cache_entry_bytes (e->size);
+  free (e);
+}
+
+/* Writes the oldest page in the swap cache back to its slot on the swap
+   device and removes it from the cache.  Holding cache_lock until it is
+   written keeps readers of the slot waiting for it.  cache_lock must be
+   held */
+static void
+cache_writeback (void)
+{
+  struct cache_entry *e = list_entry (list_front (&cache_pages),
+                                      struct cache_entry, elem);
+  const void *page = writeback_buffer;
+
+  cache_decompress (e, writeback_buffer);
+  swap_write_device (e->slot, &page, 1);
+  cache_remove (e);
+  cache_writebacks++;
+}
+
+/* Page compression.
+
+   A compressed page is a sequence of runs.  A control byte below
+   0x80 is followed by that many plus one literal bytes.  A
+   control byte C of 0x80 or more is followed by a two-byte
+   little-endian offset OFS, and repeats the C - 0x80 + LZ_MIN_MATCH
+   bytes that start OFS bytes back in the output, which may
+   overlap the bytes being written.  Matches are found through a
+   hash table of the last position at which each three-byte
+   string was seen. */
+
+#define LZ_MIN_MATCH 3                          /* Shortest match */
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 0x7f)      /* Longest match */
+#define LZ_MAX_LITERALS 0x80                    /* Longest literal run */
+#define LZ_HASH_BITS 12                         /* log2 of table size */
+#define LZ_NONE 0xffff                          /* Empty table entry */
+
+/* Last position of each hashed three-byte string, or LZ_NONE.
+   Guarded by cache_lock */
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+/* Returns the lz_table index for the three bytes at P */
+static unsigned
+lz_hash (const uint8_t *p)
+{
+  uint32_t v = (uint32_t) p[0] << 16 | (uint32_t) p[1] << 8 | p[2];
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends the CNT literal bytes at SRC to DST, which holds *OUT bytes
+   of at most LIMIT.  Returns false if they do not fit */
+static bool
+lz_literals (const uint8_t *src, size_t cnt, uint8_t *dst, size_t *out,
+             size_t limit)
+{
+  while (cnt > 0)
+    {
+      size_t run = cnt < LZ_MAX_LITERALS ? cnt : LZ_MAX_LITERALS;
+      if (*out + 1 + run > limit)
+        return false;
+      dst[(*out)++] = run - 1;
+      memcpy (dst + *out, src, run);
+      *out += run;
+      src += run;
+      cnt -= run;
+    }
+  return true;
+}
+
+/* Compresses the page at SRC into DST, which has room for LIMIT
+   bytes.  Returns the compressed size, or 0 if it would exceed
+   LIMIT.  cache_lock must be held */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t limit)
+{
+  size_t in = 0, out = 0;
+  size_t literals = 0;          // start of bytes not yet written out
+
+  memset (lz_table, 0xff, sizeof lz_table);
+  while (in + LZ_MIN_MATCH <= PGSIZE)
+    {
+      unsigned h = lz_hash (src + in);
+      size_t match = lz_table[h];
+      lz_table[h] = in;
+
+      if (match == LZ_NONE || memcmp (src + match, src + in, LZ_MIN_MATCH))
+        {
+          in++;
+          continue;
+        }
+
+      size_t len = LZ_MIN_MATCH;
+      while (in + len < PGSIZE && len < LZ_MAX_MATCH
+             && src[match + len] == src[in + len])
+        len++;
+
+      size_t ofs = in - match;
+      if (!lz_literals (src + literals, in - literals, dst, &out, limit)
+          || out + 3 > limit)
+        return 0;
+      dst[out++] = 0x80 | (len - LZ_MIN_MATCH);
+      dst[out++] = ofs & 0xff;
+      dst[out++] = ofs >> 8;
+      in += len;
+      literals = in;
+    }
+  if (!lz_literals (src + literals, PGSIZE - literals, dst, &out, limit))
+    return 0;
+  return out;
+}
+
+/* Decompresses the SIZE bytes at SRC, made by lz_compress(), into the
+   page at DST */
+static void
+lz_decompress (const uint8_t *src, size_t size, uint8_t *dst)
+{
+  size_t in = 0, out = 0;
+
+  while (in < size)
+    {
+      uint8_t c = src[in++];
+      if (c < 0x80)
+        {
+          size_t run = c + 1;
+          ASSERT (out + run <= PGSIZE);
+          memcpy (dst + out, src + in, run);
+          in += run;
+          out += run;
+        }
+      else
+        {
+          size_t len = (c & 0x7f) + LZ_MIN_MATCH;
+          size_t ofs = src[in] | src[in + 1] << 8;
+          in += 2;
+          ASSERT (ofs > 0 && ofs <= out && out + len <= PGSIZE);
+          for (; len > 0; len--, out++)
+            dst[out] = dst[out - ofs];
+        }
+    }
+  ASSERT (out == PGSIZE);
 }
@@ -3,9 +3,16 @@
 
 #include <stddef.h>
 
+/* Most pages that swap_write() and swap_read() transfer at once */
+#define SWAP_CLUSTER 8
+
 void swap_init (void);
+size_t swap_alloc (size_t cnt);
+void swap_write (size_t slot, const void *const pages[], size_t cnt);
+void swap_read (size_t slot, void *const pages[], size_t cnt);
 size_t swap_out (const void *vaddr);
 void swap_in (void *vaddr, size_t slot);
 void swap_drop (size_t slot);
+void swap_print_stats (void);
 
 #endif /* devices/swap.h */
@@ -21,8 +21,37 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
-/* list of threads waiting on a timer */
-static struct list timer_waiters;
+/* Threads waiting on a timer, in a hierarchical timing wheel.
+
+   Level L has TIMER_WHEEL_SIZE slots, each covering
+   TIMER_WHEEL_SIZE**L ticks, and holds waiters due fewer than
+   TIMER_WHEEL_SIZE**(L+1) ticks from now in the slot selected by
+   the corresponding bits of their end_ticks.  Each tick wakes
+   everything in the current level 0 slot.  Whenever the lower
+   levels wrap around, the next slot up is cascaded: its waiters
+   are redistributed into the levels below.  Waiters due beyond
+   the top level wait in timer_overflow until the top level
+   wraps.  Sleeping is therefore O(1), and a tick touches only
+   the waiters that are due, plus an occasional cascade. */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS 4
+static struct list timer_wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+static struct list timer_overflow;
+
+/* PIT count for one timer tick. */
+#define TIMER_PIT_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Most ticks a single one-shot PIT count can cover. */
+#define TIMER_IDLE_MAX_TICKS (PIT_COUNT_MAX / TIMER_PIT_COUNT)
+
+/* While the idle thread has stopped the periodic timer, the
+   number of ticks until the pending one-shot interrupt, and the
+   PIT count it was programmed with.  Both are 0 while the timer
+   is periodic. */
+static int64_t oneshot_ticks;
+static unsigned oneshot_count;
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
@@ -33,7 +62,10 @@ static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
-static bool end_tick_sort (const struct list_elem *a, const struct list_elem *b, void *aux UNUSED);
+static void timer_wheel_insert (struct t_waiter *);
+static void timer_wheel_cascade (struct list *);
+static int64_t timer_idle_ticks (void);
+static void timer_skip (int64_t);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -42,7 +74,11 @@ timer_init (void)
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
-  list_init(&timer_waiters);
+
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    for (int slot = 0; slot < TIMER_WHEEL_SIZE; slot++)
+      list_init (&timer_wheel[level][slot]);
+  list_init (&timer_overflow);
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -107,23 +143,62 @@ timer_sleep (int64_t ticks)
     waiter.end_ticks = start + ticks;
     strlcpy (waiter.thread, thread_current()->name, sizeof waiter.thread);
 
-    /* add struct to timer_waiters list */
+    /* add struct to the timer wheel, unless a tick has already
+       carried us past end_ticks (TICKS here is the sleep length,
+       so read the current time with interrupts off) */
     enum intr_level old_level = intr_disable ();
-    list_insert_ordered(&timer_waiters, &waiter.elem, end_tick_sort, NULL);
+    bool expired = waiter.end_ticks <= timer_ticks ();
+    if (!expired)
+      timer_wheel_insert (&waiter);
     intr_set_level (old_level);
 
     /* wait for thread to be woken */
-    sema_down(&waiter.sema);
+    if (!expired)
+      sema_down(&waiter.sema);
   }
 }
 
-static bool end_tick_sort (const struct list_elem *a,
-                           const struct list_elem *b, void *aux UNUSED)
- {
-  struct t_waiter *aw = (list_entry (a, struct t_waiter, elem));
-  struct t_waiter *bw = (list_entry (b, struct t_waiter, elem));
-  return aw->end_ticks < bw->end_ticks;
- }
+/* Adds WAITER to the timer wheel slot from which it will be
+   woken at WAITER->end_ticks.  WAITER must not be due before the
+   current tick.  Interrupts must be off. */
+static void
+timer_wheel_insert (struct t_waiter *waiter)
+{
+  int64_t delta = waiter->end_ticks - ticks;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (delta >= 0);
+
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+      int shift = TIMER_WHEEL_BITS * level;
+      if (delta < (int64_t) TIMER_WHEEL_SIZE << shift)
+        {
+          int slot = (waiter->end_ticks >> shift) & TIMER_WHEEL_MASK;
+          list_push_back (&timer_wheel[level][slot], &waiter->elem);
+          return;
+        }
+    }
+  list_push_back (&timer_overflow, &waiter->elem);
+}
+
+/* Moves every waiter in SLOT back into the timer wheel, which
+   files each one at a lower level than before, or back into
+   timer_overflow if it is still too far in the future. */
+static void
+timer_wheel_cascade (struct list *slot)
+{
+  struct list waiters;
+
+  list_init (&waiters);
+  if (!list_empty (slot))
+    list_splice (list_end (&waiters), list_begin (slot), list_end (slot));
+  while (!list_empty (&waiters))
+    {
+      struct list_elem *e = list_pop_front (&waiters);
+      timer_wheel_insert (list_entry (e, struct t_waiter, elem));
+    }
+}
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
    turned on. */
@@ -188,6 +263,93 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts.  If no sleeper is due on the next tick, stops the
+   periodic timer and arms a single interrupt for the first tick
+   on which one is, so that an idle machine is not woken
+   TIMER_FREQ times a second for nothing. */
+void
+timer_idle_enter (void)
+{
+  int64_t idle_ticks;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks != 0)
+    return;
+
+  idle_ticks = timer_idle_ticks ();
+  if (idle_ticks <= 1)
+    return;
+
+  oneshot_ticks = idle_ticks;
+  oneshot_count = idle_ticks * TIMER_PIT_COUNT;
+  pit_configure_oneshot (0, oneshot_count);
+}
+
+/* Called with interrupts off when the idle thread is about to be
+   switched out.  If it was woken early by some other interrupt,
+   credits the whole ticks that have passed and rearms the PIT to
+   interrupt on the next tick boundary, where the periodic timer
+   resumes in step with the old one. */
+void
+timer_idle_exit (void)
+{
+  unsigned count, elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return;
+
+  /* Once the counter reaches 0 it wraps around past the count we
+     loaded.  The interrupt is then pending, and will catch up on
+     its own as soon as interrupts are enabled. */
+  count = pit_read_count (0);
+  if (count == 0 || count > oneshot_count)
+    return;
+
+  elapsed = (oneshot_count - count) / TIMER_PIT_COUNT;
+  timer_skip (elapsed);
+
+  oneshot_ticks -= elapsed;
+  oneshot_count = count - (oneshot_ticks - 1) * TIMER_PIT_COUNT;
+  oneshot_ticks = 1;
+  pit_configure_oneshot (0, oneshot_count);
+}
+
+/* Returns the number of ticks from now until the first tick on
+   which the timer interrupt has work to do besides counting, up
+   to TIMER_IDLE_MAX_TICKS. */
+static int64_t
+timer_idle_ticks (void)
+{
+  int64_t n;
+
+  /* The recent_cpu sweep advances on every tick. */
+  if (thread_refresh_pending ())
+    return 1;
+
+  for (n = 1; n < TIMER_IDLE_MAX_TICKS; n++)
+    {
+      int64_t t = ticks + n;
+
+      if (!list_empty (&timer_wheel[0][t & TIMER_WHEEL_MASK])
+          || (t & TIMER_WHEEL_MASK) == 0
+          || (thread_mlfqs && t % TIMER_FREQ == 0))
+        break;
+    }
+  return n;
+}
+
+/* Advances the clock by N ticks on which nothing is due. */
+static void
+timer_skip (int64_t n)
+{
+  ticks += n;
+  thread_tick_idle (n);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
@@ -199,18 +361,38 @@ timer_print_stats (void)
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  /* if the idle thread stopped the timer, account for the ticks
+     skipped, which had nothing due, and go back to periodic
+     interrupts */
+  if (oneshot_ticks != 0) {
+    timer_skip (oneshot_ticks - 1);
+    oneshot_ticks = oneshot_count = 0;
+    pit_configure_channel (0, 2, TIMER_FREQ);
+  }
+
   ticks++;
-  struct t_waiter *waiter;
-
-  /* remove and wake up all threads in timer_waiter that have expired their timer */
-  while (!list_empty(&timer_waiters)) {
-    waiter = list_entry (list_front(&timer_waiters), struct t_waiter, elem);
-    if (waiter->end_ticks <= ticks) {
-      sema_up(&waiter->sema);
-      list_pop_front(&timer_waiters);
-    } else {
+
+  /* cascade each level whose lower levels have just wrapped
+     around, and the overflow list once the top level has */
+  int level;
+  for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+    int shift = TIMER_WHEEL_BITS * level;
+    if ((ticks & (((int64_t) 1 << shift) - 1)) != 0)
       break;
-    }
+    timer_wheel_cascade (&timer_wheel[level][(ticks >> shift)
+                                             & TIMER_WHEEL_MASK]);
+  }
+  if (level == TIMER_WHEEL_LEVELS
+      && (ticks & (((int64_t) 1 << (TIMER_WHEEL_BITS * level)) - 1)) == 0)
+    timer_wheel_cascade (&timer_overflow);
+
+  /* wake up all threads in the current slot, which are all due now */
+  struct list *slot = &timer_wheel[0][ticks & TIMER_WHEEL_MASK];
+  while (!list_empty(slot)) {
+    struct t_waiter *waiter = list_entry (list_pop_front(slot),
+                                          struct t_waiter, elem);
+    ASSERT (waiter->end_ticks == ticks);
+    sema_up(&waiter->sema);
   }
   thread_tick ();
 }
@@ -13,7 +13,7 @@
 struct t_waiter
   {
     char thread[16];          /* name of thread for debugging purposes */
-    struct list_elem elem;    /* list element for timer_waiters list */
+    struct list_elem elem;    /* list element for a timer wheel slot */
     struct semaphore sema;    /* semaphore to wake up thread */
     int64_t end_ticks;        /* number of elapsed ticks needed for the thread to wake */
   };
@@ -35,6 +35,10 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Tickless idle. */
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
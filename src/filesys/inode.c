@@ -6,6 +6,9 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -36,9 +39,13 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock data_lock;            /* Readers share, writers exclude. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Cache of in-memory inodes. */
+static struct kmem_cache inode_cache;
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -62,6 +69,7 @@ void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  kmem_cache_init (&inode_cache, "inode", sizeof (struct inode), NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -127,7 +135,7 @@ inode_open (block_sector_t sector)
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (&inode_cache);
   if (inode == NULL)
     return NULL;
 
@@ -137,6 +145,7 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  rwlock_init (&inode->data_lock);
   block_read (fs_device, inode->sector, &inode->data);
   return inode;
 }
@@ -181,7 +190,7 @@ inode_close (struct inode *inode)
                             bytes_to_sectors (inode->data.length)); 
         }
 
-      free (inode); 
+      kmem_cache_free (&inode_cache, inode);
     }
 }
 
@@ -196,7 +205,14 @@ inode_remove (struct inode *inode)
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+
+   BUFFER may be user memory, whose pages may have to be faulted
+   in, perhaps by writing back or reading in a mapped page of
+   this very inode.  So data_lock is only held while a sector is
+   read from disk, and a user buffer is filled from a bounce
+   buffer once it is released.  A read is thus atomic only a
+   sector at a time. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
@@ -220,10 +236,13 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE
+          && !is_user_vaddr (buffer + bytes_read))
         {
           /* Read full sector directly into caller's buffer. */
+          rwlock_acquire_read (&inode->data_lock);
           block_read (fs_device, sector_idx, buffer + bytes_read);
+          rwlock_release_read (&inode->data_lock);
         }
       else 
         {
@@ -235,7 +254,9 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
               if (bounce == NULL)
                 break;
             }
+          rwlock_acquire_read (&inode->data_lock);
           block_read (fs_device, sector_idx, bounce);
+          rwlock_release_read (&inode->data_lock);
           memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
         }
       
@@ -253,7 +274,12 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
    (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   growth is not yet implemented.)
+
+   As in inode_read_at(), data_lock is never held while BUFFER
+   is read, so a user buffer is first copied a sector at a time
+   into kernel memory, and a write is atomic only a sector at a
+   time. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
@@ -281,21 +307,34 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
+      /* Data to write, copied out of user memory first. */
+      const uint8_t *chunk = buffer + bytes_written;
+      bool full = sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE;
+      if (!full || is_user_vaddr (chunk))
         {
-          /* We need a bounce buffer. */
+          /* We need a bounce buffer, and another sector to stage
+             user data in. */
           if (bounce == NULL) 
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
+              bounce = malloc (2 * BLOCK_SECTOR_SIZE);
               if (bounce == NULL)
                 break;
             }
+          if (is_user_vaddr (chunk))
+            {
+              memcpy (bounce + BLOCK_SECTOR_SIZE, chunk, chunk_size);
+              chunk = bounce + BLOCK_SECTOR_SIZE;
+            }
+        }
 
+      rwlock_acquire_write (&inode->data_lock);
+      if (full)
+        {
+          /* Write full sector directly to disk. */
+          block_write (fs_device, sector_idx, chunk);
+        }
+      else 
+        {
           /* If the sector contains data before or after the chunk
              we're writing, then we need to read in the sector
              first.  Otherwise we start with a sector of all zeros. */
@@ -303,9 +342,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
             block_read (fs_device, sector_idx, bounce);
           else
             memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
+          memcpy (bounce + sector_ofs, chunk, chunk_size);
           block_write (fs_device, sector_idx, bounce);
         }
+      rwlock_release_write (&inode->data_lock);
 
       /* Advance. */
       size -= chunk_size;
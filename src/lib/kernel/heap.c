@@ -0,0 +1,198 @@
+#include "heap.h"
+#include "../debug.h"
+
+static bool precedes (const struct heap *, const struct heap_elem *,
+                      const struct heap_elem *);
+static struct heap_elem *meld (const struct heap *, struct heap_elem *,
+                               struct heap_elem *);
+static struct heap_elem *merge_pairs (const struct heap *,
+                                      struct heap_elem *);
+static void detach (struct heap *, struct heap_elem *);
+
+/* Initializes HEAP as an empty heap ordered by LESS given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *heap, heap_less_func *less, void *aux)
+{
+  ASSERT (heap != NULL);
+  ASSERT (less != NULL);
+
+  heap->root = NULL;
+  heap->elem_cnt = 0;
+  heap->next_seq = 0;
+  heap->less = less;
+  heap->aux = aux;
+}
+
+/* Inserts ELEM into HEAP. */
+void
+heap_push (struct heap *heap, struct heap_elem *elem)
+{
+  ASSERT (heap != NULL);
+  ASSERT (elem != NULL);
+
+  elem->prev = elem->child = elem->next = NULL;
+  elem->seq = heap->next_seq++;
+  heap->root = meld (heap, heap->root, elem);
+  heap->elem_cnt++;
+}
+
+/* Returns the greatest element in HEAP, without removing it.
+   Undefined behavior if HEAP is empty. */
+struct heap_elem *
+heap_top (struct heap *heap)
+{
+  ASSERT (!heap_empty (heap));
+  return heap->root;
+}
+
+/* Removes and returns the greatest element in HEAP.
+   Undefined behavior if HEAP is empty. */
+struct heap_elem *
+heap_pop (struct heap *heap)
+{
+  struct heap_elem *top = heap_top (heap);
+
+  heap_remove (heap, top);
+  return top;
+}
+
+/* Removes ELEM, which must be in HEAP. */
+void
+heap_remove (struct heap *heap, struct heap_elem *elem)
+{
+  ASSERT (!heap_empty (heap));
+
+  detach (heap, elem);
+  heap->root = meld (heap, heap->root, merge_pairs (heap, elem->child));
+  elem->child = NULL;
+  heap->elem_cnt--;
+}
+
+/* Restores HEAP's ordering after the value of ELEM, which must be
+   in HEAP, has changed.  ELEM keeps its original insertion order
+   relative to elements that compare equal to it. */
+void
+heap_update (struct heap *heap, struct heap_elem *elem)
+{
+  struct heap_elem *children;
+
+  ASSERT (!heap_empty (heap));
+
+  detach (heap, elem);
+  children = elem->child;
+  elem->child = NULL;
+  heap->root = meld (heap, heap->root, merge_pairs (heap, children));
+  heap->root = meld (heap, heap->root, elem);
+}
+
+/* Returns the number of elements in HEAP. */
+size_t
+heap_size (struct heap *heap)
+{
+  return heap->elem_cnt;
+}
+
+/* Returns true if HEAP contains no elements, false otherwise. */
+bool
+heap_empty (struct heap *heap)
+{
+  return heap->root == NULL;
+}
+
+/* Returns true if A should be nearer the top of HEAP than B:
+   either it is greater, or it is equal and was inserted first. */
+static bool
+precedes (const struct heap *heap, const struct heap_elem *a,
+          const struct heap_elem *b)
+{
+  if (heap->less (b, a, heap->aux))
+    return true;
+  if (heap->less (a, b, heap->aux))
+    return false;
+  return (int) (a->seq - b->seq) < 0;
+}
+
+/* Combines the heaps rooted at A and B, either of which may be
+   null, and returns the new root.  A and B must have no
+   siblings. */
+static struct heap_elem *
+meld (const struct heap *heap, struct heap_elem *a, struct heap_elem *b)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+
+  if (precedes (heap, b, a))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  /* Make B the leftmost child of A. */
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  a->prev = a->next = NULL;
+  return a;
+}
+
+/* Melds the sibling list starting at FIRST into a single heap,
+   pairing siblings left to right and then combining the pairs
+   right to left, and returns its root. */
+static struct heap_elem *
+merge_pairs (const struct heap *heap, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* First pass: meld adjacent siblings, stacking the results. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      first = b != NULL ? b->next : NULL;
+      a->prev = a->next = NULL;
+      if (b != NULL)
+        b->prev = b->next = NULL;
+
+      a = meld (heap, a, b);
+      a->next = pairs;
+      pairs = a;
+    }
+
+  /* Second pass: meld the pairs from last to first. */
+  while (pairs != NULL)
+    {
+      struct heap_elem *p = pairs;
+
+      pairs = p->next;
+      p->next = NULL;
+      root = meld (heap, root, p);
+    }
+  return root;
+}
+
+/* Unlinks ELEM, together with its subtree, from its parent and
+   siblings in HEAP. */
+static void
+detach (struct heap *heap, struct heap_elem *elem)
+{
+  if (elem == heap->root)
+    heap->root = NULL;
+  else
+    {
+      if (elem->prev->child == elem)
+        elem->prev->child = elem->next;
+      else
+        elem->prev->next = elem->next;
+      if (elem->next != NULL)
+        elem->next->prev = elem->prev;
+    }
+  elem->prev = elem->next = NULL;
+}
@@ -0,0 +1,69 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   This is an intrusive max-heap in the style of lib/kernel/list.h:
+   each structure that can be in a heap embeds a struct heap_elem
+   member, no dynamic allocation is performed, and the heap_entry
+   macro converts a struct heap_elem back to the structure that
+   contains it.
+
+   The heap is a pairing heap.  Insertion takes constant time, and
+   removing the top element, removing an arbitrary element or
+   re-keying an element after its priority changes take amortized
+   O(log n) time.  Elements that compare equal leave the heap in
+   the order they were first inserted, so a heap of waiters is
+   FIFO within each priority. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *prev;     /* Parent if leftmost child, else left sibling. */
+    struct heap_elem *child;    /* Leftmost child. */
+    struct heap_elem *next;     /* Right sibling. */
+    unsigned seq;               /* Insertion order, to break ties. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->next     \
+                     - offsetof (STRUCT, MEMBER.next)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B.  The greatest
+   element is at the top of the heap. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Top element, or null if empty. */
+    size_t elem_cnt;            /* Number of elements in heap. */
+    unsigned next_seq;          /* Sequence number for next insertion. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_top (struct heap *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+size_t heap_size (struct heap *);
+bool heap_empty (struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -28,7 +28,17 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* User-space synchronization. */
+    SYS_FUTEX_WAIT,             /* Sleep while a word holds a value. */
+    SYS_FUTEX_WAKE,             /* Wake threads sleeping on a word. */
+
+    /* Diagnostics. */
+    SYS_MEMINFO,                /* Print kernel memory usage. */
+
+    /* Process creation. */
+    SYS_FORK                    /* Duplicate this process. */
   };
 
 #endif /* lib/syscall-nr.h */
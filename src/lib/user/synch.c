@@ -0,0 +1,115 @@
+#include <synch.h>
+#include <limits.h>
+#include <syscall.h>
+
+/* Atomically stores NEW in *P if it holds OLD.  Returns the
+   value *P held beforehand. */
+static inline int
+compare_exchange (int *p, int old, int new)
+{
+  /* See [IA32-v2a] "CMPXCHG". */
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "+a" (old), "+m" (*p)
+                : "r" (new)
+                : "memory");
+  return old;
+}
+
+/* Atomically stores NEW in *P and returns its previous value. */
+static inline int
+exchange (int *p, int new)
+{
+  /* See [IA32-v2b] "XCHG". */
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+/* Atomically adds 1 to *P. */
+static inline void
+increment (int *p)
+{
+  asm volatile ("lock incl %0" : "+m" (*p) : : "memory");
+}
+
+/* Initializes MUTEX as unlocked. */
+void
+mutex_init (struct mutex *mutex)
+{
+  mutex->state = 0;
+}
+
+/* Acquires MUTEX, sleeping in the kernel only if another thread
+   holds it. */
+void
+mutex_lock (struct mutex *mutex)
+{
+  int c = compare_exchange (&mutex->state, 0, 1);
+  if (c == 0)
+    return;
+
+  /* Mark the mutex contended before sleeping, so that the holder
+     knows to wake us when it unlocks. */
+  if (c != 2)
+    c = exchange (&mutex->state, 2);
+  while (c != 0)
+    {
+      futex_wait (&mutex->state, 2);
+      c = exchange (&mutex->state, 2);
+    }
+}
+
+/* Tries to acquire MUTEX without sleeping.  Returns true if
+   successful, false if it is already held. */
+bool
+mutex_trylock (struct mutex *mutex)
+{
+  return compare_exchange (&mutex->state, 0, 1) == 0;
+}
+
+/* Releases MUTEX, waking one waiter if there may be any. */
+void
+mutex_unlock (struct mutex *mutex)
+{
+  if (exchange (&mutex->state, 0) == 2)
+    futex_wake (&mutex->state, 1);
+}
+
+/* Initializes COND. */
+void
+condvar_init (struct condvar *cond)
+{
+  cond->seq = 0;
+}
+
+/* Atomically releases MUTEX and waits for COND to be signaled,
+   then reacquires MUTEX before returning.  As with any condition
+   variable, the caller must re-check its condition afterward. */
+void
+condvar_wait (struct condvar *cond, struct mutex *mutex)
+{
+  int seq = cond->seq;
+
+  mutex_unlock (mutex);
+  futex_wait (&cond->seq, seq);
+
+  /* Other threads may have been woken with us, so reacquire as
+     contended to make sure they are woken in turn. */
+  while (exchange (&mutex->state, 2) != 0)
+    futex_wait (&mutex->state, 2);
+}
+
+/* Wakes one thread waiting on COND, if any. */
+void
+condvar_signal (struct condvar *cond)
+{
+  increment (&cond->seq);
+  futex_wake (&cond->seq, 1);
+}
+
+/* Wakes all threads waiting on COND. */
+void
+condvar_broadcast (struct condvar *cond)
+{
+  increment (&cond->seq);
+  futex_wake (&cond->seq, INT_MAX);
+}
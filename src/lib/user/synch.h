@@ -0,0 +1,38 @@
+#ifndef __LIB_USER_SYNCH_H
+#define __LIB_USER_SYNCH_H
+
+#include <stdbool.h>
+
+/* Mutexes and condition variables for user programs.
+
+   Both are built on the futex_wait() and futex_wake() system
+   calls.  Locking and unlocking an uncontended mutex never
+   enters the kernel. */
+
+/* Mutex. */
+struct mutex
+  {
+    int state;          /* 0: unlocked, 1: locked, 2: locked with waiters. */
+  };
+
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init (struct mutex *);
+void mutex_lock (struct mutex *);
+bool mutex_trylock (struct mutex *);
+void mutex_unlock (struct mutex *);
+
+/* Condition variable. */
+struct condvar
+  {
+    int seq;            /* Bumped by every signal or broadcast. */
+  };
+
+#define CONDVAR_INITIALIZER { 0 }
+
+void condvar_init (struct condvar *);
+void condvar_wait (struct condvar *, struct mutex *);
+void condvar_signal (struct condvar *);
+void condvar_broadcast (struct condvar *);
+
+#endif /* lib/user/synch.h */
@@ -182,3 +182,27 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+futex_wait (int *uaddr, int val)
+{
+  return syscall2 (SYS_FUTEX_WAIT, uaddr, val);
+}
+
+int
+futex_wake (int *uaddr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, uaddr, cnt);
+}
+
+void
+meminfo (void)
+{
+  syscall0 (SYS_MEMINFO);
+}
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
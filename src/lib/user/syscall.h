@@ -45,4 +45,14 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* User-space synchronization. */
+int futex_wait (int *uaddr, int val);
+int futex_wake (int *uaddr, int cnt);
+
+/* Diagnostics. */
+void meminfo (void);
+
+/* Process creation. */
+pid_t fork (void);
+
 #endif /* lib/user/syscall.h */
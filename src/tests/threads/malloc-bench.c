@@ -0,0 +1,109 @@
+/* Measures the cost of kernel malloc() and free() with and
+   without the per-thread block cache, and of growing a block
+   with realloc(), checking along the way that realloc() keeps
+   the block's contents.  The timings are only reported, not
+   checked, since they depend on the machine. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+#define ITER_CNT 1000
+
+/* Enough live blocks at once to overflow the cache, so most
+   calls take the descriptor lock. */
+#define BURST_CNT (MALLOC_CACHE_DEPTH * 8)
+
+/* Largest size reached by the realloc() benchmark. */
+#define GROW_MAX (64 * 1024)
+
+static uint64_t rdtsc (void);
+static void check_fill (const uint8_t *, size_t from, size_t to);
+
+void
+test_malloc_bench (void)
+{
+  void *blocks[BURST_CNT];
+  uint8_t *p;
+  uint64_t start, cycles;
+  size_t size, moves;
+  int i, j;
+
+  /* Same-size malloc() and free(), served from the cache. */
+  start = rdtsc ();
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      p = malloc (64);
+      if (p == NULL)
+        fail ("malloc failed");
+      free (p);
+    }
+  cycles = rdtsc () - start;
+  msg ("cached malloc+free of 64 bytes: %"PRIu64" cycles",
+       cycles / ITER_CNT);
+
+  /* Bursts too deep for the cache, taking the lock as before. */
+  start = rdtsc ();
+  for (i = 0; i < ITER_CNT / BURST_CNT; i++)
+    {
+      for (j = 0; j < BURST_CNT; j++)
+        {
+          blocks[j] = malloc (64);
+          if (blocks[j] == NULL)
+            fail ("malloc failed");
+        }
+      for (j = 0; j < BURST_CNT; j++)
+        free (blocks[j]);
+    }
+  cycles = rdtsc () - start;
+  msg ("uncached malloc+free of 64 bytes: %"PRIu64" cycles",
+       cycles / (ITER_CNT / BURST_CNT * BURST_CNT));
+
+  /* Grow one block a little at a time, counting moves. */
+  p = NULL;
+  moves = 0;
+  start = rdtsc ();
+  for (size = 16; size <= GROW_MAX; size += 16)
+    {
+      uint8_t *q = realloc (p, size);
+      if (q == NULL)
+        fail ("realloc to %zu bytes failed", size);
+      if (p != NULL && q != p)
+        {
+          check_fill (q, 0, size - 16);
+          moves++;
+        }
+      for (i = size - 16; i < (int) size; i++)
+        q[i] = i;
+      p = q;
+    }
+  cycles = rdtsc () - start;
+  check_fill (p, 0, GROW_MAX);
+  free (p);
+  msg ("realloc growth to %d bytes: %"PRIu64" cycles per call, %zu moves",
+       GROW_MAX, cycles / (GROW_MAX / 16), moves);
+}
+
+/* Returns the processor's time-stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  /* See [IA32-v2b] "RDTSC". */
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Fails unless bytes FROM...TO of P hold their offsets' low
+   bytes, as written by test_malloc_bench(). */
+static void
+check_fill (const uint8_t *p, size_t from, size_t to)
+{
+  size_t i;
+
+  for (i = from; i < to; i++)
+    if (p[i] != (uint8_t) i)
+      fail ("byte %zu changed from %d to %d", i, (uint8_t) i, p[i]);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The timings vary from machine to machine, so only check that
+# each benchmark ran to completion.
+for my $re (qr/^\(malloc-bench\) cached malloc\+free of 64 bytes: \d+ cycles$/,
+	    qr/^\(malloc-bench\) uncached malloc\+free of 64 bytes: \d+ cycles$/,
+	    qr/^\(malloc-bench\) realloc growth to \d+ bytes: \d+ cycles per call, \d+ moves$/,
+	    qr/^\(malloc-bench\) end$/) {
+    fail "missing output matching $re\n" if !grep (/$re/, @output);
+}
+pass;
@@ -0,0 +1,67 @@
+/* Checks that a thread that sleeps for longer than the scheduler
+   keeps per-second decay history comes back with its recent_cpu
+   decayed and its priority restored.
+
+   The main thread spins for 10 seconds, building up recent_cpu,
+   then creates a "spinner" thread and sleeps for 10 seconds more
+   than RECENT_CPU_HISTORY.  While it sleeps, only the spinner
+   runs, so its recent_cpu climbs and its priority falls.  If every
+   decay the main thread missed while asleep is applied, its
+   recent_cpu is back to 0 and it wakes with (very nearly) full
+   priority, ahead of the spinner. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Seconds the main thread sleeps. */
+#define SLEEP_SECONDS (RECENT_CPU_HISTORY + 10)
+
+static void spinner_thread (void *done_);
+
+void
+test_mlfqs_sleep_long (void) 
+{
+  struct semaphore done;
+  int64_t start_time;
+  int priority;
+  
+  ASSERT (thread_mlfqs);
+
+  msg ("Main thread spinning for 10 seconds...");
+  start_time = timer_ticks ();
+  while (timer_elapsed (start_time) < 10 * TIMER_FREQ)
+    continue;
+
+  msg ("Main thread creating spinner thread, sleeping %d seconds...",
+       SLEEP_SECONDS);
+  sema_init (&done, 0);
+  thread_create ("spinner", PRI_DEFAULT, spinner_thread, &done);
+  timer_sleep (SLEEP_SECONDS * TIMER_FREQ);
+
+  priority = thread_get_priority ();
+  if (priority < PRI_MAX - 1)
+    fail ("Main thread woke up with priority %d, expected at least %d.",
+          priority, PRI_MAX - 1);
+  msg ("Main thread woke up with full priority.");
+
+  sema_down (&done);
+  msg ("Spinner thread done.");
+}
+
+static void
+spinner_thread (void *done_) 
+{
+  struct semaphore *done = done_;
+  int64_t start_time;
+
+  msg ("Spinner thread spinning for %d seconds...", SLEEP_SECONDS + 5);
+  start_time = timer_ticks ();
+  while (timer_elapsed (start_time) < (SLEEP_SECONDS + 5) * TIMER_FREQ)
+    continue;
+
+  sema_up (done);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mlfqs-sleep-long) begin
+(mlfqs-sleep-long) Main thread spinning for 10 seconds...
+(mlfqs-sleep-long) Main thread creating spinner thread, sleeping 74 seconds...
+(mlfqs-sleep-long) Spinner thread spinning for 79 seconds...
+(mlfqs-sleep-long) Main thread woke up with full priority.
+(mlfqs-sleep-long) Spinner thread done.
+(mlfqs-sleep-long) end
+EOF
+pass;
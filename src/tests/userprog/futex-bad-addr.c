@@ -0,0 +1,15 @@
+/* Passes a misaligned address to futex_wake().
+   The process must be terminated with exit code -1. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int words[2];
+
+void
+test_main (void) 
+{
+  futex_wake ((int *) ((char *) words + 1), 1);
+  fail ("should have exited with -1");
+}
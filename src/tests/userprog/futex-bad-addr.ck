@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-bad-addr) begin
+futex-bad-addr: exit(-1)
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Exercises the futex system calls and the user mutex and
+   condition variable built on them, within one thread: a
+   futex_wait() on a word that does not hold the expected value
+   must return -1 at once, and a futex_wake() with nobody waiting
+   must wake no one.  A wait that actually sleeps needs a second
+   thread sharing the word, which user programs cannot create, so
+   it is not tested here. */
+
+#include <syscall.h>
+#include <synch.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int word = 1;
+
+void
+test_main (void) 
+{
+  struct mutex mutex = MUTEX_INITIALIZER;
+  struct condvar cond = CONDVAR_INITIALIZER;
+
+  CHECK (futex_wait (&word, 0) == -1, "futex_wait on mismatched value");
+  CHECK (futex_wake (&word, 1) == 0, "futex_wake with no waiters");
+
+  msg ("lock mutex");
+  mutex_lock (&mutex);
+  CHECK (!mutex_trylock (&mutex), "trylock held mutex");
+  msg ("signal with no waiters");
+  condvar_signal (&cond);
+  condvar_broadcast (&cond);
+  msg ("unlock mutex");
+  mutex_unlock (&mutex);
+  CHECK (mutex_trylock (&mutex), "trylock free mutex");
+  mutex_unlock (&mutex);
+}
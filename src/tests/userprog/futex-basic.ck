@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-basic) begin
+(futex-basic) futex_wait on mismatched value
+(futex-basic) futex_wake with no waiters
+(futex-basic) lock mutex
+(futex-basic) trylock held mutex
+(futex-basic) signal with no waiters
+(futex-basic) unlock mutex
+(futex-basic) trylock free mutex
+(futex-basic) end
+futex-basic: exit(0)
+EOF
+pass;
@@ -0,0 +1,39 @@
+/* Forks a child that checks that it sees its parent's memory and
+   then overwrites it, and checks that the parent's memory is
+   unchanged by the child's writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (128 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  pid_t child;
+  int i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  child = fork ();
+  if (child == 0)
+    {
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != (char) (i % 251))
+          fail ("child read byte %d as %d", i, buf[i]);
+      memset (buf, 0x5a, SIZE);
+      exit (0x42);
+    }
+
+  CHECK (child != PID_ERROR, "fork");
+  CHECK (wait (child) == 0x42, "wait for child");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 251))
+      fail ("byte %d changed to %d by child", i, buf[i]);
+  msg ("parent's memory unchanged");
+}
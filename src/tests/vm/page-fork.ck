@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork) begin
+(page-fork) fork
+(page-fork) wait for child
+(page-fork) parent's memory unchanged
+(page-fork) end
+EOF
+pass;
@@ -5,4 +5,12 @@
 #define FLAG_MBS  0x00000002    /* Must be set. */
 #define FLAG_IF   0x00000200    /* Interrupt Flag. */
 
+/* CR4 Register. */
+#define CR4_PSE   0x00000010    /* Page Size Extensions (4 MB pages). */
+#define CR4_PGE   0x00000080    /* Page Global Enable. */
+
+/* Feature flags returned in EDX by CPUID with EAX = 1. */
+#define CPUID_PSE 0x00000008    /* CR4_PSE supported. */
+#define CPUID_PGE 0x00002000    /* CR4_PGE supported. */
+
 #endif /* threads/flags.h */
@@ -15,6 +15,7 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -33,6 +34,9 @@
 #endif
 #ifdef VM
 #include "devices/swap.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/share.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
@@ -66,6 +70,7 @@ static void paging_init (void);
 static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
+static void print_meminfo (char **argv);
 static void usage (void);
 
 #ifdef FILESYS
@@ -116,10 +121,12 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  palloc_start_zeroer ();
   serial_init_queue ();
   timer_calibrate ();
 
@@ -131,8 +138,12 @@ main (void)
 #endif
 
 #ifdef VM
-  /* Initialise the swap disk */  
+  /* Initialise the swap disk, the frame and page tables and the
+     table of shared pages. */
   swap_init ();
+  frame_init ();
+  page_init ();
+  share_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -161,15 +172,30 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   Where the CPU supports it, each whole 4 MB of RAM is mapped
+   with a single large page instead of a page table, and every
+   kernel mapping is made global, so that switching page
+   directories in pagedir_activate() does not flush it from the
+   TLB.  The 4 MB that hold the kernel's text keep 4 kB pages so
+   that the text stays read-only, as does any last partial 4 MB
+   of RAM. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t leaf = 1, features, global;
+  bool large_pages;
 
-  pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  /* See [IA32-v2a] "CPUID". */
+  asm ("cpuid" : "+a" (leaf), "=d" (features) : : "ebx", "ecx");
+  large_pages = (features & CPUID_PSE) != 0;
+  global = features & CPUID_PGE ? PTE_G : 0;
+
+  pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO | PAL_PAGEDIR);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++)
     {
@@ -179,13 +205,35 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (large_pages && pte_idx == 0
+          && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large_kernel (vaddr, true) | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
-          pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+          pt = palloc_get_page (PAL_ASSERT | PAL_ZERO | PAL_PAGEDIR);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
+    }
+
+  /* Allow large pages and global mappings before using them.
+     See [IA32-v3a] 2.5 "Control Registers". */
+  if (large_pages || global)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      if (large_pages)
+        cr4 |= CR4_PSE;
+      if (global)
+        cr4 |= CR4_PGE;
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4));
     }
 
   /* Store the physical address of the page directory into CR3
@@ -267,6 +315,10 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-sl"))
+        stack_page_limit = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -300,6 +352,15 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Prints how much memory the page allocator and malloc() have
+   handed out, now and at most since boot. */
+static void
+print_meminfo (char **argv UNUSED)
+{
+  palloc_print_usage ();
+  malloc_print_usage ();
+}
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -317,6 +378,7 @@ run_actions (char **argv)
   static const struct action actions[] = 
     {
       {"run", 2, run_task},
+      {"meminfo", 1, print_meminfo},
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
@@ -365,6 +427,7 @@ usage (void)
 #else
           "  run TEST           Run TEST.\n"
 #endif
+          "  meminfo            Print kernel memory usage.\n"
 #ifdef FILESYS
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
@@ -389,6 +452,9 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -sl=COUNT          Limit each process's stack to COUNT pages.\n"
 #endif
           );
   shutdown_power_off ();
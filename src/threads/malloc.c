@@ -5,8 +5,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -32,7 +34,20 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Taking the descriptor's lock costs far more than the list
+   operation it protects, so each thread also keeps a few free
+   blocks of each small size in its own struct malloc_cache.  A
+   block freed into the cache, or allocated out of it, needs only
+   interrupts disabled for a moment.  Cached blocks still count
+   as in use in their arena; malloc_cache_flush() gives them back
+   when the thread exits.
+
+   realloc() resizes in place when it can: when the new size
+   still belongs to the block's descriptor, or, for a big block,
+   by giving back pages it no longer needs or taking over free
+   pages that follow it (see palloc_extend()). */
 
 /* Descriptor. */
 struct desc
@@ -40,6 +55,7 @@ struct desc
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
+    size_t arena_cnt;           /* Number of arenas. */
     struct lock lock;           /* Lock. */
   };
 
@@ -58,12 +74,22 @@ struct arena
 struct block 
   {
     struct list_elem free_elem; /* Free list element. */
+    struct block *next;         /* Next block in a thread's cache. */
   };
 
 /* Our set of descriptors. */
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Pages held by big blocks, guarded by disabling interrupts. */
+static size_t big_page_cnt;
+
+static struct desc *size_to_desc (size_t size);
+static struct block *cache_get (struct desc *);
+static bool cache_put (struct desc *, struct block *);
+static void block_release (struct desc *, struct block *);
+static bool resize_in_place (void *block, size_t new_size);
+static void count_big_pages (long delta);
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
@@ -82,6 +108,7 @@ malloc_init (void)
       list_init (&d->free_list);
       lock_init (&d->lock);
     }
+  ASSERT (desc_cnt >= MALLOC_CACHE_DESCS);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -97,19 +124,16 @@ malloc (size_t size)
   if (size == 0)
     return NULL;
 
-  /* Find the smallest descriptor that satisfies a SIZE-byte
-     request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
-  if (d == descs + desc_cnt) 
+  d = size_to_desc (size);
+  if (d == NULL)
     {
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = palloc_get_multiple (PAL_MALLOC, page_cnt);
       if (a == NULL)
         return NULL;
+      count_big_pages (page_cnt);
 
       /* Initialize the arena to indicate a big block of PAGE_CNT
          pages, and return it. */
@@ -119,6 +143,10 @@ malloc (size_t size)
       return a + 1;
     }
 
+  b = cache_get (d);
+  if (b != NULL)
+    return b;
+
   lock_acquire (&d->lock);
 
   /* If the free list is empty, create a new arena. */
@@ -127,7 +155,7 @@ malloc (size_t size)
       size_t i;
 
       /* Allocate a page. */
-      a = palloc_get_page (0);
+      a = palloc_get_page (PAL_MALLOC);
       if (a == NULL) 
         {
           lock_release (&d->lock);
@@ -138,6 +166,7 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = d;
       a->free_cnt = d->blocks_per_arena;
+      d->arena_cnt++;
       for (i = 0; i < d->blocks_per_arena; i++) 
         {
           struct block *b = arena_to_block (a, i);
@@ -199,6 +228,8 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && resize_in_place (old_block, new_size))
+    return old_block;
   else 
     {
       void *new_block = malloc (new_size);
@@ -232,37 +263,209 @@ free (void *p)
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
-            {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
-            }
 
-          lock_release (&d->lock);
+          if (!cache_put (d, b))
+            block_release (d, b);
         }
       else
         {
           /* It's a big block.  Free its pages. */
+          count_big_pages (-(long) a->free_cnt);
           palloc_free_multiple (a, a->free_cnt);
           return;
         }
     }
 }
 
+/* Gives every block in C, which must belong to the running
+   thread, back to its descriptor. */
+void
+malloc_cache_flush (struct malloc_cache *c)
+{
+  size_t i;
+
+  for (i = 0; i < MALLOC_CACHE_DESCS; i++)
+    for (;;)
+      {
+        enum intr_level old_level = intr_disable ();
+        struct block *b = c->blocks[i];
+        if (b != NULL)
+          {
+            c->blocks[i] = b->next;
+            c->cnt[i]--;
+          }
+        intr_set_level (old_level);
+
+        if (b == NULL)
+          break;
+        block_release (&descs[i], b);
+      }
+}
+
+/* Returns the smallest descriptor that satisfies a SIZE-byte
+   request, or a null pointer if SIZE needs a big block. */
+static struct desc *
+size_to_desc (size_t size)
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->block_size >= size)
+      return d;
+  return NULL;
+}
+
+/* Takes a block of D's size from the running thread's cache,
+   or returns a null pointer if it has none. */
+static struct block *
+cache_get (struct desc *d)
+{
+  size_t i = d - descs;
+  struct malloc_cache *c;
+  enum intr_level old_level;
+  struct block *b;
+
+  if (i >= MALLOC_CACHE_DESCS)
+    return NULL;
+
+  old_level = intr_disable ();
+  c = &thread_current ()->malloc_cache;
+  b = c->blocks[i];
+  if (b != NULL)
+    {
+      c->blocks[i] = b->next;
+      c->cnt[i]--;
+    }
+  intr_set_level (old_level);
+  return b;
+}
+
+/* Puts block B, of D's size, into the running thread's cache.
+   Returns false if B's size is not cached or the cache for it
+   is full. */
+static bool
+cache_put (struct desc *d, struct block *b)
+{
+  size_t i = d - descs;
+  struct malloc_cache *c;
+  enum intr_level old_level;
+  bool success = false;
+
+  if (i >= MALLOC_CACHE_DESCS)
+    return false;
+
+  old_level = intr_disable ();
+  c = &thread_current ()->malloc_cache;
+  if (c->cnt[i] < MALLOC_CACHE_DEPTH)
+    {
+      b->next = c->blocks[i];
+      c->blocks[i] = b;
+      c->cnt[i]++;
+      success = true;
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Returns block B to descriptor D's free list, freeing its
+   arena if that leaves the arena entirely unused. */
+static void
+block_release (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  lock_acquire (&d->lock);
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      palloc_free_page (a);
+      d->arena_cnt--;
+    }
+
+  lock_release (&d->lock);
+}
+
+/* Tries to make BLOCK hold NEW_SIZE bytes without moving it,
+   returning true if successful.  A small block stays put if
+   NEW_SIZE maps to its own descriptor.  A big block gives back
+   the pages it no longer needs, or takes over the free pages
+   that follow it. */
+static bool
+resize_in_place (void *block, size_t new_size)
+{
+  struct arena *a = block_to_arena (block);
+  size_t page_cnt;
+
+  if (a->desc != NULL)
+    return size_to_desc (new_size) == a->desc;
+
+  page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+  if (page_cnt < a->free_cnt)
+    palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                          a->free_cnt - page_cnt);
+  else if (page_cnt > a->free_cnt
+           && !palloc_extend (a, a->free_cnt, page_cnt))
+    return false;
+  count_big_pages ((long) page_cnt - (long) a->free_cnt);
+  a->free_cnt = page_cnt;
+  return true;
+}
+
+/* Prints, for each block size, how many arenas there are and
+   how many of their blocks are in use, counting blocks held in
+   threads' caches as in use, followed by the pages held by big
+   blocks. */
+void
+malloc_print_usage (void)
+{
+  enum intr_level old_level;
+  size_t big_pages;
+  struct desc *d;
+
+  printf ("malloc:\n");
+  for (d = descs; d < descs + desc_cnt; d++)
+    {
+      size_t arena_cnt, free_cnt;
+
+      lock_acquire (&d->lock);
+      arena_cnt = d->arena_cnt;
+      free_cnt = list_size (&d->free_list);
+      lock_release (&d->lock);
+
+      if (arena_cnt > 0)
+        printf ("  %4zu-byte blocks: %zu arenas, %zu of %zu blocks in use\n",
+                d->block_size, arena_cnt,
+                arena_cnt * d->blocks_per_arena - free_cnt,
+                arena_cnt * d->blocks_per_arena);
+    }
+
+  old_level = intr_disable ();
+  big_pages = big_page_cnt;
+  intr_set_level (old_level);
+  printf ("  big blocks: %zu pages\n", big_pages);
+}
+
+/* Adds DELTA to the count of pages held by big blocks. */
+static void
+count_big_pages (long delta)
+{
+  enum intr_level old_level = intr_disable ();
+  big_page_cnt += delta;
+  intr_set_level (old_level);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -3,11 +3,26 @@
 
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
+
+/* Each thread caches up to MALLOC_CACHE_DEPTH free blocks for
+   each of the MALLOC_CACHE_DESCS smallest block sizes. */
+#define MALLOC_CACHE_DESCS 5
+#define MALLOC_CACHE_DEPTH 8
+
+/* A thread's cache of free small blocks.  Owned by malloc.c. */
+struct malloc_cache
+  {
+    void *blocks[MALLOC_CACHE_DESCS];   /* Stack of blocks per size. */
+    uint8_t cnt[MALLOC_CACHE_DESCS];    /* Number of blocks in each. */
+  };
 
 void malloc_init (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_cache_flush (struct malloc_cache *);
+void malloc_print_usage (void);
 
 #endif /* threads/malloc.h */
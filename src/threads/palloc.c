@@ -7,8 +7,12 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <list.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -25,20 +29,115 @@
    half to the user pool.  That should be huge overkill for the
    kernel pool, but that's just fine for demonstration purposes. */
 
+/* Pages are handed out by a binary buddy allocator.  Each pool
+   keeps a free list of blocks of 2**ORDER pages for every ORDER
+   up to PALLOC_MAX_ORDER, with each block aligned (relative to
+   the pool base) to its own size.  An allocation splits the
+   smallest large-enough free block, and a free merges a block
+   with its "buddy" for as long as the buddy is free too, so both
+   take O(log n) time.  A request for a number of pages that is
+   not a power of 2 has the unused tail of its block given back
+   right away, so callers still free exactly what they asked for.
+
+   Free blocks are linked through their own first page.  The
+   pool's used_map still records which pages are allocated, for
+   sanity checks and for palloc_print_stats().
+
+   Single pages, by far the most common request, are served from
+   a small magazine in front of each pool instead.  It is refilled
+   from, and drained back to, the buddy allocator PALLOC_MAG_BATCH
+   pages at a time, so most single-page allocations and frees take
+   neither the pool lock nor touch its bitmap.  Pages in a
+   magazine remain marked used in used_map.  Only one CPU runs
+   kernel code at present, so a single magazine per pool, guarded
+   by disabling interrupts, serves as the per-CPU one.
+
+   A low-priority "pagezero" thread also keeps a second magazine
+   per pool stocked with pages it has already filled with zeros,
+   taking them from the free pages while nothing else wants the
+   CPU.  PAL_ZERO requests for a single page are served from it
+   first, keeping the memset off the caller's path.
+
+   Each pool also counts the pages in use, both in total and for
+   each allocation site named by the caller's PAL_* site flag,
+   along with the most ever in use at once.  palloc_print_usage()
+   reports them, which is what to go by when choosing -ul.  The
+   site of every used page is kept so that frees, which do not
+   name one, are charged to the right site.  Pages sitting in a
+   magazine count as free. */
+
+/* A magazine of cached free single pages. */
+#define PALLOC_MAG_SIZE 32              /* Capacity of a magazine. */
+#define PALLOC_MAG_BATCH 16             /* Pages moved per refill or drain. */
+struct magazine
+  {
+    size_t cnt;                         /* Number of pages cached. */
+    void *pages[PALLOC_MAG_SIZE];       /* Cached pages. */
+  };
+
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
+    struct spinlock lock;               /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    uint8_t *block_order;               /* Per page: order | BLOCK_FREE
+                                           if it heads a free block. */
+    struct list free_lists[PALLOC_MAX_ORDER + 1]; /* Free blocks. */
+    size_t free_cnt[PALLOC_MAX_ORDER + 1];        /* Lengths of free_lists. */
+    unsigned free_orders;               /* Bit N set iff free_lists[N]
+                                           is nonempty. */
+    struct magazine magazine;           /* Cached single pages. */
+    struct magazine zeroed;             /* Cached zero-filled pages. */
+
+    /* Accounting, guarded by disabling interrupts. */
+    uint8_t *page_site;                 /* Per page: site of a used page. */
+    size_t used_cnt;                    /* Pages in use. */
+    size_t used_peak;                   /* Most pages ever in use. */
+    size_t site_cnt[PALLOC_SITE_CNT];   /* Pages in use per site. */
+    size_t site_peak[PALLOC_SITE_CNT];  /* Most pages ever in use per site. */
   };
 
+/* Marks a block_order entry as heading a free block. */
+#define BLOCK_FREE 0x80
+
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Names of the allocation sites, indexed by site number. */
+static const char *site_names[PALLOC_SITE_CNT] =
+  {"other", "thread", "pagedir", "malloc", "slab"};
+
+/* Raised when a zeroed magazine runs low, to wake the zeroer. */
+static struct semaphore zero_wanted;
+
+/* True while zero_wanted has been raised and the zeroer has not
+   yet woken to act on it.  Keeps the semaphore at most 1 when the
+   zeroer cannot refill the magazines for lack of free pages. */
+static bool zero_requested;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t block_alloc (struct pool *, int order);
+static void block_free (struct pool *, size_t page_idx, int order);
+static void range_free (struct pool *, size_t page_idx, size_t page_cnt);
+static bool page_claim (struct pool *, size_t page_idx);
+static int page_cnt_order (size_t page_cnt);
+static size_t pool_alloc (struct pool *, size_t page_cnt);
+static void pool_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void *magazine_get (struct pool *);
+static void magazine_put (struct pool *, void *page);
+static void magazine_drain (struct pool *, struct magazine *, size_t keep);
+static void *zeroed_get (struct pool *);
+static bool zero_one_page (struct pool *);
+static thread_func zeroer;
+static void account_alloc (struct pool *, size_t page_idx, size_t page_cnt,
+                           int site);
+static void account_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void print_pool_stats (struct pool *, const char *name);
+static void print_pool_usage (struct pool *, const char *name);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -55,6 +154,8 @@ palloc_init (size_t user_page_limit)
     user_pages = user_page_limit;
   kernel_pages = free_pages - user_pages;
 
+  sema_init (&zero_wanted, 0);
+
   /* Give half of memory to kernel, half to user. */
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
@@ -71,24 +172,52 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  bool zeroed = false;
   void *pages;
-  size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  if (page_cnt == 1)
+    {
+      pages = NULL;
+      if (flags & PAL_ZERO)
+        {
+          pages = zeroed_get (pool);
+          zeroed = pages != NULL;
+        }
+      if (pages == NULL)
+        pages = magazine_get (pool);
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+      /* Zeroed pages are still free pages, if nothing else is. */
+      if (pages == NULL && !(flags & PAL_ZERO))
+        pages = zeroed_get (pool);
+    }
   else
-    pages = NULL;
+    {
+      size_t page_idx = pool_alloc (pool, page_cnt);
+      if (page_idx == BITMAP_ERROR)
+        {
+          /* Cached pages may be what splits the free space up. */
+          enum intr_level old_level = intr_disable ();
+          spinlock_acquire (&pool->lock);
+          magazine_drain (pool, &pool->magazine, 0);
+          magazine_drain (pool, &pool->zeroed, 0);
+          spinlock_release (&pool->lock);
+          intr_set_level (old_level);
+          page_idx = pool_alloc (pool, page_cnt);
+        }
+      if (page_idx != BITMAP_ERROR)
+        pages = pool->base + PGSIZE * page_idx;
+      else
+        pages = NULL;
+    }
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      account_alloc (pool, pg_no (pages) - pg_no (pool->base), page_cnt,
+                     (flags & PAL_SITE_MASK) >> PAL_SITE_SHIFT);
+      if ((flags & PAL_ZERO) && !zeroed)
         memset (pages, 0, PGSIZE * page_cnt);
     }
   else 
@@ -118,7 +247,6 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
-  size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -131,14 +259,170 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   else
     NOT_REACHED ();
 
-  page_idx = pg_no (pages) - pg_no (pool->base);
-
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  account_free (pool, pg_no (pages) - pg_no (pool->base), page_cnt);
+
+  if (page_cnt == 1)
+    magazine_put (pool, pages);
+  else
+    pool_free (pool, pg_no (pages) - pg_no (pool->base), page_cnt);
+}
+
+/* Tries to grow the allocation of PAGE_CNT pages at PAGES to
+   NEW_PAGE_CNT pages without moving it, by claiming the pages
+   that follow it.  Returns true if successful, false (changing
+   nothing) if any of those pages is in use or beyond the end of
+   the pool. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_page_cnt)
+{
+  struct pool *pool;
+  enum intr_level old_level;
+  size_t page_idx, extra_cnt, i;
+  bool success;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (new_page_cnt >= page_cnt);
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base) + page_cnt;
+  extra_cnt = new_page_cnt - page_cnt;
+  if (page_idx + extra_cnt > pool->page_cnt)
+    return false;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  success = bitmap_none (pool->used_map, page_idx, extra_cnt);
+  if (success)
+    {
+      for (i = 0; i < extra_cnt; i++)
+        if (!page_claim (pool, page_idx + i))
+          NOT_REACHED ();
+      bitmap_set_multiple (pool->used_map, page_idx, extra_cnt, true);
+    }
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+
+  if (success)
+    account_alloc (pool, page_idx, extra_cnt, pool->page_site[page_idx - 1]);
+  return success;
+}
+
+/* Prints the number of free blocks of each order in each pool. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool, "Kernel pool");
+  print_pool_stats (&user_pool, "User pool");
+}
+
+/* Prints POOL's free block counts under NAME. */
+static void
+print_pool_stats (struct pool *pool, const char *name)
+{
+  size_t free_cnt[PALLOC_MAX_ORDER + 1];
+  size_t free_pages = 0;
+  enum intr_level old_level;
+  int order;
+
+  size_t cached;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  for (order = 0; order <= PALLOC_MAX_ORDER; order++)
+    {
+      free_cnt[order] = pool->free_cnt[order];
+      free_pages += free_cnt[order] << order;
+    }
+  cached = pool->magazine.cnt + pool->zeroed.cnt;
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+
+  printf ("%s: %zu of %zu pages free, %zu cached; free blocks by order:",
+          name, free_pages, pool->page_cnt, cached);
+  for (order = 0; order <= PALLOC_MAX_ORDER; order++)
+    printf (" %zu", free_cnt[order]);
+  printf ("\n");
+}
+
+/* Prints how many pages each pool and each allocation site has
+   in use, now and at most. */
+void
+palloc_print_usage (void)
+{
+  print_pool_usage (&kernel_pool, "Kernel pool");
+  print_pool_usage (&user_pool, "User pool");
+}
+
+/* Prints POOL's page usage under NAME. */
+static void
+print_pool_usage (struct pool *pool, const char *name)
+{
+  size_t site_cnt[PALLOC_SITE_CNT], site_peak[PALLOC_SITE_CNT];
+  size_t used_cnt, used_peak;
+  enum intr_level old_level;
+  int site;
+
+  old_level = intr_disable ();
+  used_cnt = pool->used_cnt;
+  used_peak = pool->used_peak;
+  memcpy (site_cnt, pool->site_cnt, sizeof site_cnt);
+  memcpy (site_peak, pool->site_peak, sizeof site_peak);
+  intr_set_level (old_level);
+
+  printf ("%s: %zu of %zu pages in use, peak %zu\n",
+          name, used_cnt, pool->page_cnt, used_peak);
+  for (site = 0; site < PALLOC_SITE_CNT; site++)
+    if (site_peak[site] > 0)
+      printf ("  %-8s %6zu pages, peak %zu\n",
+              site_names[site] != NULL ? site_names[site] : "?",
+              site_cnt[site], site_peak[site]);
+}
+
+/* Charges the PAGE_CNT pages starting at PAGE_IDX in POOL, just
+   allocated, to allocation site SITE. */
+static void
+account_alloc (struct pool *pool, size_t page_idx, size_t page_cnt, int site)
+{
+  enum intr_level old_level;
+
+  ASSERT (site < PALLOC_SITE_CNT);
+
+  memset (pool->page_site + page_idx, site, page_cnt);
+
+  old_level = intr_disable ();
+  pool->used_cnt += page_cnt;
+  if (pool->used_cnt > pool->used_peak)
+    pool->used_peak = pool->used_cnt;
+  pool->site_cnt[site] += page_cnt;
+  if (pool->site_cnt[site] > pool->site_peak[site])
+    pool->site_peak[site] = pool->site_cnt[site];
+  intr_set_level (old_level);
+}
+
+/* Credits the PAGE_CNT pages starting at PAGE_IDX in POOL, about
+   to be freed, back to the sites they were allocated for. */
+static void
+account_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  enum intr_level old_level;
+  size_t i;
+
+  old_level = intr_disable ();
+  ASSERT (pool->used_cnt >= page_cnt);
+  pool->used_cnt -= page_cnt;
+  for (i = page_idx; i < page_idx + page_cnt; i++)
+    pool->site_cnt[pool->page_site[i]]--;
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -153,20 +437,361 @@ palloc_free_page (void *page)
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
+  /* We'll put the pool's used_map, block_order array and
+     page_site array at its base.  Calculate the space needed for
+     them and subtract it from the pool's size. */
+  size_t meta_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt) + 2 * page_cnt,
+                                    PGSIZE);
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  int order;
+
+  if (meta_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  page_cnt -= meta_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  spinlock_init (&p->lock);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->block_order = (uint8_t *) base + bm_size;
+  memset (p->block_order, 0, page_cnt);
+  p->page_site = p->block_order + page_cnt;
+  p->base = base + meta_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  for (order = 0; order <= PALLOC_MAX_ORDER; order++)
+    {
+      list_init (&p->free_lists[order]);
+      p->free_cnt[order] = 0;
+    }
+  p->free_orders = 0;
+  p->magazine.cnt = 0;
+  p->zeroed.cnt = 0;
+  p->used_cnt = p->used_peak = 0;
+  memset (p->site_cnt, 0, sizeof p->site_cnt);
+  memset (p->site_peak, 0, sizeof p->site_peak);
+
+  /* Hand every page to the buddy allocator. */
+  range_free (p, 0, page_cnt);
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL's buddy
+   allocator and returns the index of the first, or BITMAP_ERROR
+   if there is no room. */
+static size_t
+pool_alloc (struct pool *pool, size_t page_cnt)
+{
+  int order = page_cnt_order (page_cnt);
+  enum intr_level old_level;
+  size_t page_idx;
+
+  if (order > PALLOC_MAX_ORDER)
+    return BITMAP_ERROR;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  page_idx = block_alloc (pool, order);
+  if (page_idx != BITMAP_ERROR)
+    {
+      range_free (pool, page_idx + page_cnt,
+                  ((size_t) 1 << order) - page_cnt);
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+    }
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+  return page_idx;
+}
+
+/* Returns PAGE_CNT pages starting at PAGE_IDX to POOL's buddy
+   allocator. */
+static void
+pool_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  range_free (pool, page_idx, page_cnt);
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+}
+
+/* Takes a single page from POOL's magazine, first refilling it
+   with a batch from the buddy allocator if it is empty.  Returns
+   a null pointer if the pool is out of pages. */
+static void *
+magazine_get (struct pool *pool)
+{
+  struct magazine *mag = &pool->magazine;
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = intr_disable ();
+  if (mag->cnt == 0)
+    {
+      spinlock_acquire (&pool->lock);
+      while (mag->cnt < PALLOC_MAG_BATCH)
+        {
+          size_t page_idx = block_alloc (pool, 0);
+          if (page_idx == BITMAP_ERROR)
+            break;
+          ASSERT (!bitmap_test (pool->used_map, page_idx));
+          bitmap_mark (pool->used_map, page_idx);
+          mag->pages[mag->cnt++] = pool->base + PGSIZE * page_idx;
+        }
+      spinlock_release (&pool->lock);
+    }
+  if (mag->cnt > 0)
+    page = mag->pages[--mag->cnt];
+  intr_set_level (old_level);
+  return page;
+}
+
+/* Puts PAGE into POOL's magazine, first draining a batch back to
+   the buddy allocator if it is full. */
+static void
+magazine_put (struct pool *pool, void *page)
+{
+  struct magazine *mag = &pool->magazine;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (mag->cnt == PALLOC_MAG_SIZE)
+    {
+      spinlock_acquire (&pool->lock);
+      magazine_drain (pool, mag, PALLOC_MAG_SIZE - PALLOC_MAG_BATCH);
+      spinlock_release (&pool->lock);
+    }
+  ASSERT (bitmap_test (pool->used_map, pg_no (page) - pg_no (pool->base)));
+  mag->pages[mag->cnt++] = page;
+  intr_set_level (old_level);
+}
+
+/* Takes a page from POOL's zeroed magazine, or returns a null
+   pointer if it is empty.  Wakes the zeroer once the magazine
+   is half empty, unless a wakeup is already pending. */
+static void *
+zeroed_get (struct pool *pool)
+{
+  struct magazine *mag = &pool->zeroed;
+  enum intr_level old_level;
+  void *page = NULL;
+  bool low;
+
+  old_level = intr_disable ();
+  if (mag->cnt > 0)
+    page = mag->pages[--mag->cnt];
+  low = mag->cnt < PALLOC_MAG_SIZE / 2 && !zero_requested;
+  if (low)
+    zero_requested = true;
+  intr_set_level (old_level);
+
+  if (low)
+    sema_up (&zero_wanted);
+  return page;
+}
+
+/* Starts the thread that keeps the zeroed magazines stocked. */
+void
+palloc_start_zeroer (void)
+{
+  thread_create ("pagezero", PRI_MIN, zeroer, NULL);
+}
+
+/* Fills the zeroed magazines whenever they run low.  At PRI_MIN
+   (or the highest niceness) it runs only when little else
+   does. */
+static void
+zeroer (void *aux UNUSED)
+{
+  if (thread_mlfqs)
+    thread_set_nice (NICE_MAX);
+
+  for (;;)
+    {
+      bool kernel_done = !zero_one_page (&kernel_pool);
+      bool user_done = !zero_one_page (&user_pool);
+
+      if (kernel_done && user_done)
+        {
+          sema_down (&zero_wanted);
+          zero_requested = false;
+        }
+    }
+}
+
+/* Zeroes one free page of POOL and adds it to POOL's zeroed
+   magazine.  Returns false, doing nothing, if the magazine is
+   full or POOL has no free page to spare. */
+static bool
+zero_one_page (struct pool *pool)
+{
+  struct magazine *mag = &pool->zeroed;
+  enum intr_level old_level;
+  void *page;
+
+  if (mag->cnt >= PALLOC_MAG_SIZE)
+    return false;
+
+  page = magazine_get (pool);
+  if (page == NULL)
+    return false;
+  memset (page, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  if (mag->cnt < PALLOC_MAG_SIZE)
+    {
+      mag->pages[mag->cnt++] = page;
+      page = NULL;
+    }
+  intr_set_level (old_level);
+
+  if (page != NULL)
+    magazine_put (pool, page);
+  return true;
+}
+
+/* Returns pages from MAG, one of POOL's magazines, to the buddy
+   allocator until only KEEP remain.  The pool lock must be
+   held. */
+static void
+magazine_drain (struct pool *pool, struct magazine *mag, size_t keep)
+{
+  while (mag->cnt > keep)
+    {
+      size_t page_idx = pg_no (mag->pages[--mag->cnt]) - pg_no (pool->base);
+      ASSERT (bitmap_test (pool->used_map, page_idx));
+      bitmap_reset (pool->used_map, page_idx);
+      block_free (pool, page_idx, 0);
+    }
+}
+
+/* Removes a free block of 2**ORDER pages from POOL, splitting a
+   larger one if necessary, and returns the index of its first
+   page, or BITMAP_ERROR if there is no large enough free
+   block. */
+static size_t
+block_alloc (struct pool *pool, int order)
+{
+  unsigned orders = pool->free_orders & ~((1u << order) - 1);
+  struct list_elem *e;
+  size_t page_idx;
+  int o;
+
+  ASSERT (order <= PALLOC_MAX_ORDER);
+
+  if (orders == 0)
+    return BITMAP_ERROR;
+  o = __builtin_ctz (orders);
+
+  e = list_pop_front (&pool->free_lists[o]);
+  if (--pool->free_cnt[o] == 0)
+    pool->free_orders &= ~(1u << o);
+  page_idx = pg_no (e) - pg_no (pool->base);
+  pool->block_order[page_idx] = 0;
+
+  /* Give back the upper half until the block is the right size. */
+  while (o > order)
+    {
+      o--;
+      block_free (pool, page_idx + ((size_t) 1 << o), o);
+    }
+  return page_idx;
+}
+
+/* Returns the block of 2**ORDER pages starting at PAGE_IDX to
+   POOL, merging it with its buddy for as long as the buddy is
+   also free. */
+static void
+block_free (struct pool *pool, size_t page_idx, int order)
+{
+  struct list_elem *e;
+
+  while (order < PALLOC_MAX_ORDER)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy + ((size_t) 1 << order) > pool->page_cnt
+          || pool->block_order[buddy] != (BLOCK_FREE | order))
+        break;
+
+      /* Take the buddy off its free list and merge. */
+      list_remove ((struct list_elem *) (pool->base + buddy * PGSIZE));
+      if (--pool->free_cnt[order] == 0)
+        pool->free_orders &= ~(1u << order);
+      pool->block_order[buddy] = 0;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+
+  pool->block_order[page_idx] = BLOCK_FREE | order;
+  e = (struct list_elem *) (pool->base + page_idx * PGSIZE);
+  list_push_front (&pool->free_lists[order], e);
+  pool->free_cnt[order]++;
+  pool->free_orders |= 1u << order;
+}
+
+/* Takes the single page PAGE_IDX out of whichever free block of
+   POOL contains it, giving the rest of that block back as
+   smaller blocks.  Returns false if no free block contains
+   PAGE_IDX. */
+static bool
+page_claim (struct pool *pool, size_t page_idx)
+{
+  int order;
+
+  for (order = 0; order <= PALLOC_MAX_ORDER; order++)
+    {
+      size_t head = page_idx & ~(((size_t) 1 << order) - 1);
+      size_t end = head + ((size_t) 1 << order);
+
+      if (pool->block_order[head] == (BLOCK_FREE | order))
+        {
+          list_remove ((struct list_elem *) (pool->base + head * PGSIZE));
+          if (--pool->free_cnt[order] == 0)
+            pool->free_orders &= ~(1u << order);
+          pool->block_order[head] = 0;
+          range_free (pool, head, page_idx - head);
+          range_free (pool, page_idx + 1, end - (page_idx + 1));
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Returns PAGE_CNT pages starting at PAGE_IDX to POOL, as the
+   fewest aligned blocks that cover them. */
+static void
+range_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order < PALLOC_MAX_ORDER
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      block_free (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Returns the order of the smallest block that holds PAGE_CNT
+   pages. */
+static int
+page_cnt_order (size_t page_cnt)
+{
+  int order = 0;
+
+  while (((size_t) 1 << order) < page_cnt)
+    order++;
+  return order;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +801,7 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
@@ -1,20 +1,41 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
+/* Largest block handed out by the buddy allocator is
+   2**PALLOC_MAX_ORDER pages. */
+#define PALLOC_MAX_ORDER 10
+
 /* How to allocate pages. */
 enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+
+    /* What the pages are for, as counted by palloc_print_usage().
+       At most one of these may be given; the default is "other". */
+    PAL_THREAD = 010,           /* Thread structure and kernel stack. */
+    PAL_PAGEDIR = 020,          /* Page directory or page table. */
+    PAL_MALLOC = 030,           /* malloc() arena or big block. */
+    PAL_SLAB = 040,             /* Object cache slab. */
+    PAL_SITE_MASK = 070         /* All of the above. */
   };
 
+/* Allocation sites are numbered by their bits in PAL_SITE_MASK. */
+#define PAL_SITE_SHIFT 3
+#define PALLOC_SITE_CNT 8
+
 void palloc_init (size_t user_page_limit);
+void palloc_start_zeroer (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_extend (void *, size_t page_cnt, size_t new_page_cnt);
+void palloc_print_stats (void);
+void palloc_print_usage (void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,247 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator.
+
+   Each slab is a single page holding a struct slab header
+   followed by as many objects as fit.  A slab's free objects are
+   kept on a singly linked list threaded through their first
+   word.  A cache allocates from its partially used slabs first,
+   and a slab moves between the cache's `partial' and `full'
+   lists as it fills and empties.  When a slab becomes entirely
+   free it is kept as the cache's reserve if there is none yet,
+   and otherwise given back to the page allocator, so a cache
+   that oscillates around a slab boundary does not thrash.
+
+   Every operation is a few pointer updates, done with
+   interrupts off under the cache's spinlock, so caches may be
+   used wherever malloc() may, and objects may also be freed with
+   interrupts disabled. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header, at the start of its page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's partial or full list. */
+    size_t used_cnt;            /* Number of objects allocated. */
+    void *free;                 /* First free object, or null. */
+  };
+
+/* Every cache, for kmem_print_stats(). */
+static struct list all_caches = LIST_INITIALIZER (all_caches);
+static struct spinlock all_caches_lock;
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *object_to_slab (struct kmem_cache *, void *);
+
+/* Initializes CACHE to hand out objects of SIZE bytes, naming it
+   NAME in statistics.  If CTOR is nonnull, it is called on every
+   object before kmem_cache_alloc() returns it.  Allocates no
+   memory, so it may be called before the page allocator is up. */
+void
+kmem_cache_init (struct kmem_cache *cache, const char *name, size_t size,
+                 void (*ctor) (void *))
+{
+  enum intr_level old_level;
+
+  ASSERT (cache != NULL);
+  ASSERT (size > 0);
+
+  cache->name = name;
+  cache->obj_size = ROUND_UP (size < sizeof (void *) ? sizeof (void *) : size,
+                              sizeof (void *));
+  cache->objs_per_slab = (PGSIZE - sizeof (struct slab)) / cache->obj_size;
+  ASSERT (cache->objs_per_slab > 0);
+  cache->ctor = ctor;
+  spinlock_init (&cache->lock);
+  list_init (&cache->partial);
+  list_init (&cache->full);
+  cache->empty = NULL;
+  cache->slab_cnt = 0;
+  cache->active_cnt = 0;
+  cache->alloc_cnt = 0;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&all_caches_lock);
+  list_push_back (&all_caches, &cache->elem);
+  spinlock_release (&all_caches_lock);
+  intr_set_level (old_level);
+}
+
+/* Obtains and returns a new object from CACHE.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *cache)
+{
+  enum intr_level old_level;
+  struct slab *s;
+  void *obj;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&cache->lock);
+
+  if (!list_empty (&cache->partial))
+    s = list_entry (list_front (&cache->partial), struct slab, elem);
+  else
+    {
+      /* Use the reserve slab, or make a new one.  The page
+         allocator has its own lock, so drop ours meanwhile. */
+      s = cache->empty;
+      cache->empty = NULL;
+      if (s == NULL)
+        {
+          spinlock_release (&cache->lock);
+          s = slab_create (cache);
+          if (s == NULL)
+            {
+              intr_set_level (old_level);
+              return NULL;
+            }
+          spinlock_acquire (&cache->lock);
+          cache->slab_cnt++;
+        }
+      list_push_front (&cache->partial, &s->elem);
+    }
+
+  obj = s->free;
+  s->free = *(void **) obj;
+  if (++s->used_cnt == cache->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      list_push_front (&cache->full, &s->elem);
+    }
+  cache->active_cnt++;
+  cache->alloc_cnt++;
+
+  spinlock_release (&cache->lock);
+  intr_set_level (old_level);
+
+  if (cache->ctor != NULL)
+    cache->ctor (obj);
+  return obj;
+}
+
+/* Returns OBJ, which must have come from CACHE, to CACHE.  A
+   null OBJ is ignored. */
+void
+kmem_cache_free (struct kmem_cache *cache, void *obj)
+{
+  enum intr_level old_level;
+  struct slab *s, *release = NULL;
+
+  if (obj == NULL)
+    return;
+
+  s = object_to_slab (cache, obj);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  memset (obj, 0xcc, cache->obj_size);
+#endif
+
+  old_level = intr_disable ();
+  spinlock_acquire (&cache->lock);
+
+  ASSERT (s->used_cnt > 0);
+  if (s->used_cnt-- == cache->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      list_push_front (&cache->partial, &s->elem);
+    }
+  *(void **) obj = s->free;
+  s->free = obj;
+  cache->active_cnt--;
+
+  if (s->used_cnt == 0)
+    {
+      list_remove (&s->elem);
+      if (cache->empty == NULL)
+        cache->empty = s;
+      else
+        {
+          release = s;
+          cache->slab_cnt--;
+        }
+    }
+
+  spinlock_release (&cache->lock);
+  intr_set_level (old_level);
+
+  if (release != NULL)
+    palloc_free_page (release);
+}
+
+/* Prints usage statistics for every object cache. */
+void
+kmem_print_stats (void)
+{
+  enum intr_level old_level = intr_disable ();
+  struct list_elem *e;
+
+  spinlock_acquire (&all_caches_lock);
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      printf ("Cache %s: %zu-byte objects, %zu in use, %zu slabs, "
+              "%llu allocations\n",
+              c->name, c->obj_size, c->active_cnt, c->slab_cnt,
+              c->alloc_cnt);
+    }
+  spinlock_release (&all_caches_lock);
+  intr_set_level (old_level);
+}
+
+/* Allocates a page for a new slab of CACHE and threads all of its
+   objects onto the slab's free list.  Returns a null pointer if
+   no page is available. */
+static struct slab *
+slab_create (struct kmem_cache *cache)
+{
+  struct slab *s = palloc_get_page (PAL_SLAB);
+  uint8_t *obj;
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = cache;
+  s->used_cnt = 0;
+  s->free = NULL;
+  obj = (uint8_t *) (s + 1) + cache->objs_per_slab * cache->obj_size;
+  for (i = 0; i < cache->objs_per_slab; i++)
+    {
+      obj -= cache->obj_size;
+      *(void **) obj = s->free;
+      s->free = obj;
+    }
+  return s;
+}
+
+/* Returns the slab that OBJ, an object of CACHE, is inside. */
+static struct slab *
+object_to_slab (struct kmem_cache *cache, void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  /* Check that the slab is valid. */
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == cache);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT ((pg_ofs (obj) - sizeof *s) % cache->obj_size == 0);
+
+  return s;
+}
@@ -0,0 +1,38 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/spinlock.h"
+
+/* Object cache.
+
+   Hands out objects of one exact size, carved out of whole pages
+   ("slabs") obtained from the page allocator, so that a
+   structure that malloc() would round up to the next power of 2
+   wastes nothing beyond alignment.  Usually declared statically
+   by the module that owns the structure and set up once with
+   kmem_cache_init(). */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of each object, aligned. */
+    size_t objs_per_slab;       /* Objects that fit in one slab. */
+    void (*ctor) (void *);      /* Run on each object handed out. */
+    struct spinlock lock;       /* Protects everything below. */
+    struct list partial;        /* Slabs with free and used objects. */
+    struct list full;           /* Slabs with no free objects. */
+    struct slab *empty;         /* One fully free slab kept in reserve. */
+    size_t slab_cnt;            /* Slabs owned, including `empty'. */
+    size_t active_cnt;          /* Objects currently allocated. */
+    unsigned long long alloc_cnt; /* Allocations ever made. */
+    struct list_elem elem;      /* Element in list of all caches. */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+                      void (*ctor) (void *));
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
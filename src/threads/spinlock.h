@@ -0,0 +1,62 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+/* A busy-waiting lock for data shared between CPUs.
+
+   Disabling interrupts only excludes other code on the same CPU,
+   so structures that another CPU could touch (such as the page
+   allocator's pools) are additionally protected by a spinlock.
+   Only the boot CPU is started at present, so a spinlock is never
+   contended.
+   A spinlock must be acquired with interrupts off, and must never
+   be held across anything that may sleep. */
+struct spinlock
+  {
+    volatile uint32_t locked;   /* 1 if held, 0 if free. */
+  };
+
+/* Initializes LOCK as free. */
+static inline void
+spinlock_init (struct spinlock *lock)
+{
+  lock->locked = 0;
+}
+
+/* Tries once to acquire LOCK, returning true if successful. */
+static inline bool
+spinlock_try_acquire (struct spinlock *lock)
+{
+  /* See [IA32-v2b] "XCHG".  XCHG with a memory operand is
+     implicitly locked. */
+  uint32_t old = 1;
+  asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (lock->locked) : : "memory");
+  return old == 0;
+}
+
+/* Acquires LOCK, spinning until it becomes available. */
+static inline void
+spinlock_acquire (struct spinlock *lock)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!spinlock_try_acquire (lock))
+    while (lock->locked)
+      asm volatile ("pause");
+}
+
+/* Releases LOCK, which must be held. */
+static inline void
+spinlock_release (struct spinlock *lock)
+{
+  ASSERT (lock->locked);
+
+  asm volatile ("" : : : "memory");
+  lock->locked = 0;
+}
+
+#endif /* threads/spinlock.h */
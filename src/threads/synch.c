@@ -32,6 +32,11 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+static bool sema_waiter_less (const struct heap_elem *,
+                              const struct heap_elem *, void *aux);
+static bool cond_waiter_less (const struct heap_elem *,
+                              const struct heap_elem *, void *aux);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -48,7 +53,17 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, sema_waiter_less, NULL);
+}
+
+/* Orders a semaphore's waiting threads by effective priority. */
+static bool
+sema_waiter_less (const struct heap_elem *a, const struct heap_elem *b,
+                  void *aux UNUSED)
+{
+  const struct thread *ta = heap_entry (a, struct thread, waitelem);
+  const struct thread *tb = heap_entry (b, struct thread, waitelem);
+  return ta->effective_priority < tb->effective_priority;
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -69,7 +84,16 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      struct thread *cur = thread_current ();
+      heap_push (&sema->waiters, &cur->waitelem);
+
+      /* Re-key on donation here, unless cond_wait() has already
+         registered the condition's heap for this wait */
+      if (cur->wait_heap == NULL)
+        {
+          cur->wait_heap = &sema->waiters;
+          cur->wait_elem = &cur->waitelem;
+        }
       thread_block ();
     }
   sema->value--;
@@ -115,10 +139,11 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
-  if (!list_empty (&sema->waiters)) {
-    struct list_elem* max_elem = list_max (&sema->waiters, compare_max_prio, NULL);
-    struct thread *t = list_entry (max_elem, struct thread, elem);
-    list_remove (max_elem);
+  if (!heap_empty (&sema->waiters)) {
+    struct thread *t = heap_entry (heap_pop (&sema->waiters),
+                                   struct thread, waitelem);
+    if (t->wait_heap == &sema->waiters)
+      t->wait_heap = NULL;
     prio = t->effective_priority;
     thread_unblock (t);
   }
@@ -185,48 +210,10 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
-  array_init_prio (lock->donated_prios);
+  lock->max_priority = PRI_MIN;
   sema_init (&lock->semaphore, 1);
 }
 
-/* Array operation functions */
-
-/* Inserts a priority inside a list, ordered by highest to lowest priority
- * PRE: array is not full */
-void
-array_insert_ordered_prio (struct donated_prio** l, struct donated_prio* p)
-{
-    int i;
-    for (i = MAX_DONATIONS - 2; (i >= 0 && (l[i] == NULL || l[i]->priority < p->priority)); i--) {
-      l[i + 1] = l[i];
-    }
-    l[i+1] = p;
-}
-
-/* Removes element from array 
- * PRE: element is in the array */
-void
-array_remove_prio (struct donated_prio** l, struct donated_prio* p)
-{
-    int i;
-    for (i = 0; (l[i] != NULL && l[i] != p); i++) {}
-    l[i] = NULL;
-    int j;
-    for (j = i; l[j+1] != NULL; j++) {
-      l[j] = l[j+1];
-    }
-    l[j] = NULL;
-}
-
-/* Initialises array with NULL values */
-void
-array_init_prio (struct donated_prio** p)
-{
-  for (int i = 0; i < MAX_DONATIONS; i++) {
-    p[i] = NULL;
-  }
-}
-
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
@@ -243,32 +230,19 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  bool donated = false;  /* Records whether a donation has been made */
-  struct donated_prio p; /* Saves struct on stack */
-
   /* If the lock is held by a lower priority thread */
   enum intr_level old_level = intr_disable ();
   if (lock->holder != NULL && !thread_mlfqs) {
     /* Perform donation */
-    p.priority = thread_get_priority ();
-    donate_priority (lock, &p);
     thread_current ()->donated_lock = lock;
-    donated = true;
+    donate_priority (lock, thread_get_priority ());
   }
 
   sema_down (&lock->semaphore);
 
-  /* Revoke donated priority from lock */
-  lock->holder = thread_current ();
-  if (donated) {
-    thread_current ()->donated_lock = NULL;
-    array_remove_prio (lock->donated_prios, &p);
-  }
-
-  /* Pick up all donations from the lock */
-  for (int i = 0; i < MAX_DONATIONS && lock->donated_prios[i] != NULL; i++) {
-    array_insert_ordered_prio (thread_current ()->donated_prios, lock->donated_prios[i]);
-  }
+  /* Take over the donations of the remaining waiters */
+  thread_current ()->donated_lock = NULL;
+  inherit_priority (lock);
   intr_set_level(old_level);
 }
 
@@ -286,9 +260,11 @@ lock_try_acquire (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  enum intr_level old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    inherit_priority (lock);
+  intr_set_level (old_level);
   return success;
 }
 
@@ -305,7 +281,6 @@ lock_release (struct lock *lock)
 
   /* Revoke donated priorities */
   enum intr_level old_level = intr_disable ();
-  lock->holder = NULL;
   revoke_priority (lock);
 
   sema_up (&lock->semaphore);
@@ -327,18 +302,18 @@ lock_held_by_current_thread (const struct lock *lock)
 struct semaphore_elem 
   {
     struct thread *thread;              /* Thread in semaphore */
-    struct list_elem elem;              /* List element. */
+    struct heap_elem elem;              /* Heap element. */
     struct semaphore semaphore;         /* This semaphore. */
   };
 
-/* Helper function to find the highest priority waiter in a condition */
+/* Orders a condition's waiters by their thread's effective priority. */
 static bool
-waiter_prio_compare (const struct list_elem *a,
-                    const struct list_elem *b,
-                    void *aux UNUSED) {
-    struct thread *a1 = list_entry (a, struct semaphore_elem, elem)->thread;
-    struct thread *b1 = list_entry (b, struct semaphore_elem, elem)->thread;
-    return a1->effective_priority < b1->effective_priority;
+cond_waiter_less (const struct heap_elem *a, const struct heap_elem *b,
+                  void *aux UNUSED)
+{
+  struct thread *ta = heap_entry (a, struct semaphore_elem, elem)->thread;
+  struct thread *tb = heap_entry (b, struct semaphore_elem, elem)->thread;
+  return ta->effective_priority < tb->effective_priority;
 }
 
 /* Initializes condition variable COND.  A condition variable
@@ -349,7 +324,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, cond_waiter_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -376,6 +351,7 @@ void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
   struct semaphore_elem waiter;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
@@ -385,7 +361,13 @@ cond_wait (struct condition *cond, struct lock *lock)
   sema_init (&waiter.semaphore, 0);
   waiter.thread = thread_current();
 
-  list_push_back (&cond->waiters, &waiter.elem);
+  /* Interrupts are off while touching the heap, since a donation
+     may re-key it from another thread */
+  old_level = intr_disable ();
+  heap_push (&cond->waiters, &waiter.elem);
+  waiter.thread->wait_heap = &cond->waiters;
+  waiter.thread->wait_elem = &waiter.elem;
+  intr_set_level (old_level);
 
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -407,11 +389,15 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) {
-    struct list_elem *max_waiter = list_max(&cond->waiters, waiter_prio_compare, NULL);
-    sema_up(&list_entry (max_waiter, struct semaphore_elem, elem)->semaphore);
-    list_remove(max_waiter);
+  enum intr_level old_level = intr_disable ();
+  if (!heap_empty (&cond->waiters)) {
+    struct semaphore_elem *waiter = heap_entry (heap_pop (&cond->waiters),
+                                                struct semaphore_elem, elem);
+    if (waiter->thread->wait_heap == &cond->waiters)
+      waiter->thread->wait_heap = NULL;
+    sema_up (&waiter->semaphore);
   }
+  intr_set_level (old_level);
 
 }
 
@@ -427,6 +413,96 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!heap_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RWLOCK.  Any number of threads may hold a
+   readers-writer lock for reading at once, but a thread holding
+   it for writing excludes everyone else.
+
+   The lock prefers writers: once a writer starts waiting, new
+   readers queue behind it instead of joining the readers already
+   inside, so a steady stream of readers cannot starve writers.
+   Entry is through an ordinary lock, so a thread that blocks
+   behind a writer donates its priority to that writer (or to the
+   writer still waiting for readers to drain).  Readers are not
+   tracked individually and so do not receive donations; the
+   writer's wait for them is bounded because no new readers are
+   admitted meanwhile. */
+void
+rwlock_init (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init (&rwlock->writer);
+  lock_init (&rwlock->guard);
+  cond_init (&rwlock->drained);
+  rwlock->readers = 0;
+}
+
+/* Acquires RWLOCK for reading, sleeping while a writer holds it
+   or is waiting for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_acquire (&rwlock->writer);
+  lock_acquire (&rwlock->guard);
+  rwlock->readers++;
+  lock_release (&rwlock->guard);
+  lock_release (&rwlock->writer);
+}
+
+/* Releases RWLOCK, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_acquire (&rwlock->guard);
+  ASSERT (rwlock->readers > 0);
+  if (--rwlock->readers == 0)
+    cond_signal (&rwlock->drained, &rwlock->guard);
+  lock_release (&rwlock->guard);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no other thread
+   holds it for reading or writing.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_acquire (&rwlock->writer);
+  lock_acquire (&rwlock->guard);
+  while (rwlock->readers > 0)
+    cond_wait (&rwlock->drained, &rwlock->guard);
+  lock_release (&rwlock->guard);
+}
+
+/* Releases RWLOCK, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock_held_for_write (rwlock));
+
+  lock_release (&rwlock->writer);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing,
+   false otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  return lock_held_by_current_thread (&rwlock->writer);
+}
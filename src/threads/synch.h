@@ -1,28 +1,16 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
 #include <debug.h>
 
-#define MAX_DONATIONS (8)
-
-/* Represents priority donation */
-struct donated_prio
-  {
-    int priority;
-  };
-
-/* Functions for operating on an array of 'donated_prio's */
-void array_insert_ordered_prio (struct donated_prio**, struct donated_prio*);
-void array_remove_prio (struct donated_prio**, struct donated_prio*);
-void array_init_prio (struct donated_prio**);
-
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Heap of waiting threads, by priority. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -36,7 +24,8 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
-    struct donated_prio* donated_prios[MAX_DONATIONS]; /* Queue of donated priorities to lock */
+    int max_priority;           /* Highest priority donated by a waiter. */
+    struct heap_elem elem;      /* Element in holder's held_locks heap. */
   };
 
 void lock_init (struct lock *);
@@ -48,7 +37,7 @@ bool lock_held_by_current_thread (const struct lock *);
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting semaphore_elems. */
+    struct heap waiters;        /* Heap of waiting semaphore_elems. */
   };
 
 void cond_init (struct condition *);
@@ -56,6 +45,23 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock
+  {
+    struct lock writer;         /* Held by the writer, and briefly by
+                                   each reader on entry. */
+    struct lock guard;          /* Protects `readers'. */
+    struct condition drained;   /* Signaled when `readers' drops to 0. */
+    unsigned readers;           /* Number of threads holding for read. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
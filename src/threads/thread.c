@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
@@ -15,6 +16,7 @@
 #include "threads/vaddr.h"
 #include "threads/fixed-point.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/syscall.h"
@@ -26,13 +28,10 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
+static size_t thread_cnt;       /* Number of threads in all_list. */
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -43,10 +42,22 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+#ifdef USERPROG
+/* Cache of child_elems, one per user-capable thread. */
+static struct kmem_cache child_cache;
+#endif
+
 /* array of thread queues with priority equal to the index where they are stored.
    Threads with the same priority are stored in a list run in round-robin order. */
 static struct list queue_array[QUEUE_ARRAY_SIZE];
 
+/* Occupancy bitmap for queue_array: bit N is set iff queue_array[N]
+   is non-empty, so the highest ready priority is a single bsr. */
+static uint64_t ready_bitmap;
+
+/* Number of threads in THREAD_READY state across all ready queues. */
+static size_t ready_thread_cnt;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -61,6 +72,19 @@ static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 static int32_t load_avg;      /* Minutely estimate # of ready threads. */
 
+/* Lazy recent_cpu decay.  Once per second only the epoch and its
+   decay coefficient are recorded; each thread applies the decays it
+   has missed when it is next touched.  A sweep over all_list brings a
+   batch of threads up to date on each tick so that ready threads are
+   re-bucketed without a full pass at the second boundary.  The batch
+   is sized from the thread count so that the sweep ends within the
+   second, and the timer does not skip ticks while it is under way,
+   so no thread falls more than a couple of seconds behind. */
+static unsigned mlfq_epoch;                         /* # of seconds elapsed. */
+static int32_t decay_coeffs[RECENT_CPU_HISTORY];    /* Coefficient per epoch. */
+static struct list_elem *refresh_cursor;            /* Sweep position in all_list. */
+static size_t refresh_batch;                        /* Threads swept per tick. */
+
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
@@ -81,17 +105,25 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
-static void thread_update_recent_cpu (struct thread *t, void *aux UNUSED);
+static void thread_update_recent_cpu (struct thread *t);
 static void thread_update_priority (struct thread *t, void *aux UNUSED);
+static void thread_refresh_batch (void);
 static void recalculate_priority (struct thread *t);
-static void mlfq_init (void);
+static bool held_lock_less (const struct heap_elem *, const struct heap_elem *,
+                            void *aux);
+static void ready_queues_init (void);
+static void ready_queue_push (struct thread *t, int prio);
+static void ready_queue_remove (struct thread *t, int prio);
+static int ready_queue_highest (void);
 static int mlfq_highest_priority (void);
 static bool mlfq_is_empty (void);
 static void mlfq_insert (struct thread *t);
 
 static unsigned child_elem_hash (const struct hash_elem *, void * UNUSED);
 static bool child_elem_less (const struct hash_elem *, const struct hash_elem *, void * UNUSED);
+#ifdef USERPROG
 static void free_children (struct hash_elem *, void * UNUSED);
+#endif
 static void free_file (struct hash_elem *, void * UNUSED);
 
 /* Initializes the threading system by transforming the code
@@ -115,16 +147,19 @@ thread_init (void)
   lock_init (&tid_lock);
 
   list_init (&all_list);
+#ifdef USERPROG
+  kmem_cache_init (&child_cache, "child_elem", sizeof (struct child_elem),
+                   NULL);
+#endif
 
-  /* Initialise mlfqs array */
-  if (thread_mlfqs)
-    mlfq_init ();
-  else {
-    list_init (&ready_list);
-  }
+  /* Initialise the ready queues shared by both schedulers */
+  ready_queues_init ();
 
   /* Initialise system-wide load average as zero */
   load_avg = INITIAL_LOAD_AVG;
+  mlfq_epoch = 0;
+  refresh_cursor = NULL;
+  refresh_batch = RECENT_CPU_REFRESH_BATCH;
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -158,22 +193,14 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
-/* Returns the number of threads currently in the ready list. 
-   Disables interrupts to avoid any race-conditions on the ready list. */
+/* Returns the number of threads currently in the ready queues.
+   Disables interrupts to avoid any race-conditions on the ready
+   queues. */
 size_t
 threads_ready (void)
 {
   enum intr_level old_level = intr_disable ();
-  size_t ready_thread_count;
-  /* Sum the number of threads in each index if mlfqs is active */
-  if (thread_mlfqs) {
-    ready_thread_count = 0;
-    for (int i = 0; i < QUEUE_ARRAY_SIZE; i++) {
-      ready_thread_count += list_size (&queue_array[i]);
-    }
-  } else {
-    ready_thread_count = list_size (&ready_list);
-  }
+  size_t ready_thread_count = ready_thread_cnt;
   intr_set_level (old_level);
   return ready_thread_count;
 }
@@ -197,8 +224,10 @@ thread_tick (void)
 
   if (thread_mlfqs) {
     /* Increments running thread's recent CPU usage */
-    if (t != idle_thread)
+    if (t != idle_thread) {
+      thread_update_recent_cpu (t);
       t->recent_cpu = FIXED_ADD_INT (t->recent_cpu, 1);
+    }
 
     /* Updates statistics every second */
     if (timer_ticks () % TIMER_FREQ == 0) {
@@ -208,12 +237,30 @@ thread_tick (void)
       int32_t new = FIXED_DIV_INT (INT_TO_FIXED (threads_ready () + (t != idle_thread)), 60);
       load_avg = FIXED_ADD (prev, new);
 
-      /* Update recent CPU usage value for every thread */
-      thread_foreach (thread_update_recent_cpu, NULL);
+      /* Record this second's recent CPU coefficient once for all threads */
+      int32_t numer = FIXED_MUL_INT (load_avg, 2);
+      int32_t denom = FIXED_ADD_INT (numer, 1);
+      mlfq_epoch++;
+      decay_coeffs[mlfq_epoch % RECENT_CPU_HISTORY] = FIXED_DIV (numer, denom);
+
+      /* Decay the running thread now, and start a sweep over the
+         rest, taking enough threads per tick to finish in a second.
+         The timer never skips a tick while a sweep is pending, so
+         one falls behind only if threads are created faster than
+         it walks them; it then carries on where it is, and the
+         threads ahead of it apply the decays they missed when it
+         reaches them */
+      thread_update_priority (t, NULL);
+      if (refresh_cursor == NULL)
+        refresh_cursor = list_begin (&all_list);
+      refresh_batch = DIV_ROUND_UP (thread_cnt, TIMER_FREQ);
+      if (refresh_batch < RECENT_CPU_REFRESH_BATCH)
+        refresh_batch = RECENT_CPU_REFRESH_BATCH;
     } else if (timer_ticks () % PRI_UPDATE_FREQUENCY == 0) {
       /* Updates thread priority every 4 ticks */
       thread_update_priority(thread_current(), NULL);
     }
+    thread_refresh_batch ();
     check_prio (mlfq_highest_priority ());
   }
 
@@ -222,22 +269,69 @@ thread_tick (void)
     intr_yield_on_return ();
 }
 
-/* Auxilliary function that updates recent CPU values. */
+/* Accounts for TICKS timer ticks that passed without timer
+   interrupts while the idle thread ran.  The timer skips no tick
+   on which a sleeper is due, a second ends under the MLFQS, or
+   thread_refresh_pending() is true, so on the ticks it skips
+   thread_tick() would have had nothing to do but count. */
+void
+thread_tick_idle (int64_t ticks)
+{
+  idle_ticks += ticks;
+}
+
+/* Returns true if the MLFQS sweep over all threads' recent_cpu is
+   still under way, in which case every tick must reach
+   thread_tick() to advance it.  Interrupts must be off. */
+bool
+thread_refresh_pending (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  return thread_mlfqs && refresh_cursor != NULL;
+}
+
+/* Brings T's recent_cpu up to date by applying every once-per-second
+   decay it has missed since its last update.  Only RECENT_CPU_HISTORY
+   decays are recorded, but the refresh sweep reaches every thread
+   every second or two, so no thread can miss more. */
 static void
-thread_update_recent_cpu (struct thread *t, void *aux UNUSED)
+thread_update_recent_cpu (struct thread *t)
 {
   ASSERT (thread_mlfqs);
   ASSERT (intr_get_level () == INTR_OFF);
 
-  /* Coefficient for recent CPU calculation */
-  int32_t numer = FIXED_MUL_INT (load_avg, 2);
-  int32_t denom = FIXED_ADD_INT (numer, 1);
-  int32_t coeff = FIXED_DIV (numer, denom);
+  unsigned missed = mlfq_epoch - t->cpu_epoch;
+  if (missed == 0)
+    return;
+  ASSERT (missed <= RECENT_CPU_HISTORY);
+
+  for (unsigned epoch = mlfq_epoch - missed + 1; epoch != mlfq_epoch + 1; epoch++) {
+    int32_t coeff = decay_coeffs[epoch % RECENT_CPU_HISTORY];
+    t->recent_cpu = FIXED_ADD_INT (FIXED_MUL (coeff, t->recent_cpu), t->nice);
+  }
+  t->cpu_epoch = mlfq_epoch;
+}
 
-  t->recent_cpu = FIXED_ADD_INT (FIXED_MUL (coeff, t->recent_cpu), t->nice);
+/* Continues the sweep started at the last second boundary, bringing
+   the next refresh_batch threads' recent_cpu and priority up to date,
+   so that the work per tick only grows with the number of threads
+   per second of ticks. */
+static void
+thread_refresh_batch (void)
+{
+  ASSERT (thread_mlfqs);
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  /* Also update priority every 100 ticks */
-  thread_update_priority(t, NULL);
+  for (size_t i = 0; i < refresh_batch && refresh_cursor != NULL; i++) {
+    if (refresh_cursor == list_end (&all_list)) {
+      refresh_cursor = NULL;
+      break;
+    }
+    struct thread *t = list_entry (refresh_cursor, struct thread, allelem);
+    refresh_cursor = list_next (refresh_cursor);
+    thread_update_priority (t, NULL);
+  }
 }
 
 /* Function that updates the given thread's priority
@@ -248,6 +342,8 @@ thread_update_priority (struct thread *t, void *aux UNUSED)
   ASSERT (thread_mlfqs);
   ASSERT (intr_get_level () == INTR_OFF);
 
+  thread_update_recent_cpu (t);
+
   if (t->status == THREAD_BLOCKED || t == idle_thread) {
     return;
   }
@@ -265,12 +361,13 @@ thread_update_priority (struct thread *t, void *aux UNUSED)
 
   /* Reserve space in the queue if priority is unchanged */
   if (t->priority != new_priority) {
-    t->priority = new_priority;
-
     /* We check if updating should cause thread to yield elsewhere */
     if (t->status == THREAD_READY) {
-      list_remove (&t->elem);
+      ready_queue_remove (t, t->priority);
+      t->priority = new_priority;
       mlfq_insert (t);
+    } else {
+      t->priority = new_priority;
     }
   }
 }
@@ -311,7 +408,7 @@ thread_create (const char *name, int priority,
 
   ASSERT (function != NULL);
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = palloc_get_page (PAL_ZERO | PAL_THREAD);
   if (t == NULL)
     return TID_ERROR;
 
@@ -341,13 +438,16 @@ thread_create (const char *name, int priority,
   sf->ebp = 0;
 
   /* inherit niceness and recent_cpu from current thread */
+  if (thread_mlfqs)
+    thread_update_recent_cpu (thread_current ());
+  t->cpu_epoch = thread_current ()->cpu_epoch;
   t->nice = thread_current ()->nice;
   t->recent_cpu = thread_current ()->recent_cpu;
 
 #ifdef USERPROG
   hash_init (&t->files, file_elem_hash, file_elem_less, NULL);
   hash_init (&t->children, child_elem_hash, child_elem_less, NULL);
-  t->as_child = malloc(sizeof (struct child_elem));
+  t->as_child = kmem_cache_alloc (&child_cache);
 
   if (t->as_child == NULL)
     return TID_ERROR;
@@ -359,6 +459,12 @@ thread_create (const char *name, int priority,
   t->as_child->parent = thread_current ();
 
   hash_insert(&thread_current ()->children, &t->as_child->hash_elem);
+  t->filesys_reader = false;
+#endif
+
+#ifdef VM
+  list_init (&t->mappings);
+  t->next_mapid = 0;
 #endif
 
   intr_set_level (old_level);
@@ -443,35 +549,18 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
+
   t->status = THREAD_READY;
   if (thread_mlfqs) {
     mlfq_insert (t);
     thread_update_priority (t, NULL);
   } else {
-    list_push_back (&ready_list, &t->elem);
+    ready_queue_push (t, t->effective_priority);
   }
 
   intr_set_level (old_level);
 }
 
-/* Helper function to order ready_list by priority */
-bool
-prio_compare (const struct list_elem *a,
-             const struct list_elem *b,
-             void *aux UNUSED) {
-  struct thread *a1 = list_entry (a, struct thread, elem);
-  struct thread *b1 = list_entry (b, struct thread, elem);
-  return a1->effective_priority >= b1->effective_priority;
-}
-
-/* Helper function to find max priority in a list */
-bool
-compare_max_prio (const struct list_elem *a,
-             const struct list_elem *b,
-             void *aux UNUSED) {
-  return !prio_compare (a, b, NULL);
-}
-
 /* Returns the name of the running thread. */
 const char *
 thread_name (void) 
@@ -521,7 +610,7 @@ thread_exit (void)
 
   /* If parent is dead free the child_elem, otherwise sema_up to tell parent it has died */
   if (cur->as_child->dead) {
-    free(cur->as_child);
+    kmem_cache_free (&child_cache, cur->as_child);
   } else {
     cur->as_child->dead = true;
     sema_up(&cur->as_child->sema);
@@ -532,10 +621,16 @@ thread_exit (void)
   hash_destroy(&cur->files, &free_file);
 #endif
 
+  malloc_cache_flush (&thread_current ()->malloc_cache);
+
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
+  intr_disable ();
+  if (refresh_cursor == &thread_current ()->allelem)
+    refresh_cursor = list_next (refresh_cursor);
   list_remove (&thread_current ()->allelem);
+  thread_cnt--;
 
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -548,20 +643,22 @@ free_file (struct hash_elem *e, void *aux UNUSED)
 {
   struct file_elem *f = hash_entry (e, struct file_elem, hash_elem);
   file_close(f->faddr);
-  free(f);
+  file_elem_free(f);
 }
 
+#ifdef USERPROG
 /* Frees child_elem if needed, or sets dead to true. */
 static void
 free_children (struct hash_elem *e, void *aux UNUSED)
 {
   struct child_elem *a = hash_entry (e, struct child_elem, hash_elem);
   if (a->dead) {
-    free(a);
+    kmem_cache_free (&child_cache, a);
   } else {
     a->dead = true;
   }
 }
+#endif
 
 /* Yields the CPU.  The current thread is not put to sleep and
    may be scheduled again immediately at the scheduler's whim. */
@@ -579,7 +676,7 @@ thread_yield (void)
     if (thread_mlfqs)
       mlfq_insert (cur);
     else
-      list_push_back (&ready_list, &cur->elem);
+      ready_queue_push (cur, cur->effective_priority);
   }
 
   cur->status = THREAD_READY;
@@ -611,14 +708,13 @@ thread_set_priority (int new_priority)
   ASSERT (!thread_mlfqs);
 
   enum intr_level old_level = intr_disable ();
-  /* Extract highest priority element form the ready list */
   thread_current ()->priority = new_priority;
   recalculate_priority (thread_current ());
 
-  if (!list_empty (&ready_list)) {
-      check_prio (list_entry (list_max (&ready_list, compare_max_prio, NULL),
-                        struct thread, elem)->priority);
-  }
+  /* Yield if the highest priority ready thread now outranks us */
+  int highest = ready_queue_highest ();
+  if (highest >= 0)
+    check_prio (highest);
   intr_set_level (old_level);
 }
 
@@ -632,47 +728,100 @@ thread_get_priority (void)
 static void
 recalculate_priority (struct thread *t)
 {
-  int prio;
+  int prio = t->priority;
   /* Compares maximum donated priority to base priority */
   enum intr_level old_level = intr_disable ();
-  if (t->donated_prios[0] != NULL && t->donated_prios[0]->priority > t->priority) {
-      prio = t->donated_prios[0]->priority;
+  if (!heap_empty (&t->held_locks)) {
+    struct lock *top = heap_entry (heap_top (&t->held_locks), struct lock, elem);
+    if (top->max_priority > prio)
+      prio = top->max_priority;
+  }
+
+  /* A ready thread must move to the queue matching its new priority */
+  if (t->status == THREAD_READY && !thread_mlfqs
+      && t->effective_priority != prio) {
+    ready_queue_remove (t, t->effective_priority);
+    t->effective_priority = prio;
+    ready_queue_push (t, prio);
   } else {
-      prio = t->priority;
+    t->effective_priority = prio;
   }
-  t->effective_priority = prio;
+
+  /* A waiter must move within the heap it is waiting in.  That
+     includes the running thread between cond_wait() joining the
+     condition's heap and blocking, as releasing the monitor lock
+     may drop a donation; wait_heap is cleared whenever the waiter
+     leaves the heap. */
+  if (t->wait_heap != NULL)
+    heap_update (t->wait_heap, t->wait_elem);
   intr_set_level (old_level);
 }
 
-/* Donates given priority to the lock holder and every other lock in the chain */
-void
-donate_priority (struct lock *lock, struct donated_prio *p)
+/* Orders a thread's held locks by the highest priority donated
+   through each. */
+static bool
+held_lock_less (const struct heap_elem *a, const struct heap_elem *b,
+                void *aux UNUSED)
 {
-  ASSERT(intr_get_level() == INTR_OFF);
+  const struct lock *la = heap_entry (a, struct lock, elem);
+  const struct lock *lb = heap_entry (b, struct lock, elem);
+  return la->max_priority < lb->max_priority;
+}
 
-  struct thread* t = lock->holder;
+/* Donates PRIORITY to the holder of LOCK and onwards along the
+   chain of locks that each holder is itself waiting on.  The walk
+   stops as soon as a lock or holder already has at least PRIORITY,
+   since nothing further along the chain can change. */
+void
+donate_priority (struct lock *lock, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  /* Donate this threads priority to target thread */
-  array_insert_ordered_prio (t->donated_prios, p);
-  array_insert_ordered_prio (lock->donated_prios, p);
+  while (lock != NULL && lock->max_priority < priority) {
+    struct thread *t = lock->holder;
 
-  recalculate_priority (t);
+    lock->max_priority = priority;
+    if (t == NULL)
+      break;
+    heap_update (&t->held_locks, &lock->elem);
 
-  /* Donate to existing donee */
-  if (t->donated_lock != NULL){
-    donate_priority (t->donated_lock, p);
+    if (t->effective_priority >= priority)
+      break;
+    recalculate_priority (t);
+    lock = t->donated_lock;
   }
 }
 
+/* Makes the current thread the holder of LOCK, picking up the
+   donation of the highest priority thread still waiting on it. */
+void
+inherit_priority (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  struct heap *waiters = &lock->semaphore.waiters;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = cur;
+  lock->max_priority = PRI_MIN;
+  if (!heap_empty (waiters) && !thread_mlfqs)
+    lock->max_priority = heap_entry (heap_top (waiters), struct thread,
+                                     waitelem)->effective_priority;
+  heap_push (&cur->held_locks, &lock->elem);
+  recalculate_priority (cur);
+}
+
+/* Gives up LOCK's donations to the current thread, which is
+   releasing it. */
 void
 revoke_priority (struct lock *lock)
 {
   struct thread *cur = thread_current ();
 
-  for (int i = 0; i < MAX_DONATIONS && lock->donated_prios[i] != NULL; i++) {
-    array_remove_prio (cur->donated_prios, lock->donated_prios[i]);
-  }
+  ASSERT (intr_get_level () == INTR_OFF);
 
+  heap_remove (&cur->held_locks, &lock->elem);
+  lock->holder = NULL;
   recalculate_priority (cur);
 }
 
@@ -684,15 +833,14 @@ thread_set_nice (int nice)
 
   enum intr_level old_level = intr_disable ();
 
+  /* Apply pending decays with the old niceness before changing it */
+  thread_update_recent_cpu (thread_current ());
   thread_current ()->nice = nice;
   thread_update_priority (thread_current (), NULL);
 
   /* check if updating should cause thread to yield */
-  if (!mlfq_is_empty ()) {
-    check_prio (list_entry (
-      list_front (&queue_array[mlfq_highest_priority ()]),
-      struct thread, elem)->priority);
-  }
+  if (!mlfq_is_empty ())
+    check_prio (mlfq_highest_priority ());
 
   intr_set_level (old_level);
 }
@@ -718,7 +866,12 @@ thread_get_load_avg (void)
 int
 thread_get_recent_cpu (void) 
 {
-  return FIXED_TO_INT (FIXED_MUL_INT (thread_current ()->recent_cpu, 100));
+  enum intr_level old_level = intr_disable ();
+  if (thread_mlfqs)
+    thread_update_recent_cpu (thread_current ());
+  int recent_cpu = FIXED_TO_INT (FIXED_MUL_INT (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent_cpu;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -743,6 +896,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing else is runnable, so stop the periodic timer
+         until the next tick on which something is due. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -810,10 +967,11 @@ init_thread (struct thread *t, const char *name, int priority)
   t->effective_priority = priority;
   t->magic = THREAD_MAGIC;
 
-  array_init_prio (t->donated_prios);
+  heap_init (&t->held_locks, held_lock_less, NULL);
 
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
+  thread_cnt++;
   intr_set_level (old_level);
 }
 
@@ -838,22 +996,14 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (thread_mlfqs) {
-    if (mlfq_is_empty ())
-      return idle_thread;
-    else
-      return list_entry (list_pop_front (&queue_array[mlfq_highest_priority ()]),
-                         struct thread, elem);
-  } else {
-    if (list_empty (&ready_list))
-      return idle_thread;
-    else {
-      struct list_elem *next = list_max (&ready_list, compare_max_prio, NULL);
-      list_remove(next);
-      return list_entry (next, struct thread, elem);
-    }
-  }
-
+  int prio = ready_queue_highest ();
+  if (prio < 0)
+    return idle_thread;
+
+  struct thread *next = list_entry (list_front (&queue_array[prio]),
+                                    struct thread, elem);
+  ready_queue_remove (next, prio);
+  return next;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -913,11 +1063,18 @@ static void
 schedule (void) 
 {
   struct thread *cur = running_thread ();
-  struct thread *next = next_thread_to_run ();
+  struct thread *next;
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
+
+  /* The timer may have been stopped while idle; bring the clock up
+     to date before anything else runs. */
+  if (cur == idle_thread)
+    timer_idle_exit ();
+
+  next = next_thread_to_run ();
   ASSERT (is_thread (next));
 
   if (cur != next)
@@ -939,27 +1096,69 @@ allocate_tid (void)
   return tid;
 }
 
-/* Initialises the mlfq by creating an empty list behind each index. */
+/* Initialises the ready queues by creating an empty list behind each index. */
 static void
-mlfq_init (void)
+ready_queues_init (void)
 {
-  ASSERT (thread_mlfqs);
-
   for (int i = 0; i < QUEUE_ARRAY_SIZE; i++)
     list_init (&queue_array[i]);
+  ready_bitmap = 0;
+  ready_thread_cnt = 0;
+}
+
+/* Appends T to the back of ready queue PRIO and marks it occupied. */
+static void
+ready_queue_push (struct thread *t, int prio)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= prio && prio <= PRI_MAX);
+
+  list_push_back (&queue_array[prio], &t->elem);
+  ready_bitmap |= (uint64_t) 1 << prio;
+  ready_thread_cnt++;
+}
+
+/* Removes T from ready queue PRIO, clearing the queue's bit if it
+   is left empty. */
+static void
+ready_queue_remove (struct thread *t, int prio)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_remove (&t->elem);
+  if (list_empty (&queue_array[prio]))
+    ready_bitmap &= ~((uint64_t) 1 << prio);
+  ready_thread_cnt--;
+}
+
+/* Returns the index of the highest priority non-empty ready queue,
+   or -1 if every queue is empty.  Runs in constant time. */
+static int
+ready_queue_highest (void)
+{
+  uint32_t high = ready_bitmap >> 32;
+  uint32_t low = ready_bitmap;
+  uint32_t index;
+
+  if (high != 0) {
+    asm ("bsrl %1, %0" : "=r" (index) : "rm" (high));
+    return index + 32;
+  } else if (low != 0) {
+    asm ("bsrl %1, %0" : "=r" (index) : "rm" (low));
+    return index;
+  }
+  return -1;
 }
 
 /* Returns the highest priority non-empty queue in the mlfq.
-   Returns 0 if the mlfq is empty. */
+   Returns 0 if the mlfq is empty.  Constant time via ready_bitmap. */
 static int
 mlfq_highest_priority (void)
 {
   ASSERT (thread_mlfqs);
 
-  int index = PRI_MAX;
-  while (index > 0 && list_empty (&queue_array[index]))
-    index--;
-  return index;
+  int index = ready_queue_highest ();
+  return index >= 0 ? index : 0;
 }
 
 /* Returns true if each queue in the mlfq is empty. */
@@ -967,18 +1166,15 @@ static bool
 mlfq_is_empty (void)
 {
   ASSERT (thread_mlfqs);
-  int i;
-  for (i = 0; i < QUEUE_ARRAY_SIZE; i++)
-    if (!list_empty (&queue_array[i]))
-      return false;
-  return true;
+  return ready_thread_cnt == 0;
 }
 
+/* Appends T to the mlfq queue matching its current priority. */
 static void
 mlfq_insert (struct thread *t)
 {
   ASSERT (thread_mlfqs);
-  list_push_back (&queue_array[t->priority], &t->elem);
+  ready_queue_push (t, t->priority);
 }
 
 /* Offset of `stack' member within `struct thread'.
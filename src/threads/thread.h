@@ -5,6 +5,7 @@
 #include <list.h>
 #include <stdint.h>
 #include <hash.h>
+#include "threads/malloc.h"
 #include "threads/synch.h"
 
 /* States in a thread's life cycle. */
@@ -28,12 +29,21 @@ typedef int tid_t;
 
 /* Niceness, recent_cpu and load_avg all start at 0 */
 #define NICE_DEFAULT 0
+#define NICE_MAX 20
 #define RECENT_CPU_DEFAULT 0
 #define INITIAL_LOAD_AVG 0
 
 /* Priority is updated for every thread once every 4 ticks */
 #define PRI_UPDATE_FREQUENCY 4
 
+/* Number of past once-per-second recent_cpu decay coefficients kept,
+   bounding how far a thread's lazy catch-up can reach back */
+#define RECENT_CPU_HISTORY 64
+
+/* Minimum number of threads brought up to date on each timer tick;
+   more are when needed to sweep every thread within a second */
+#define RECENT_CPU_REFRESH_BATCH 8
+
 /* Size of the array containing each ready queue */
 #define QUEUE_ARRAY_SIZE 64
 
@@ -87,12 +97,12 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member is an element in the run queue (thread.c),
+   and `waitelem' an element in a semaphore's waiter heap
+   (synch.c).  While a thread is blocked in a semaphore or
+   condition variable, `wait_heap' and `wait_elem' record the heap
+   element whose position depends on its priority, so that a
+   donation can re-key it. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -102,14 +112,19 @@ struct thread
     uint8_t *stack;                     /* Saved stack pointer. */
     int effective_priority;             /* Max of base priority and donations */
     int priority;                       /* Priority. */
-    struct donated_prio* donated_prios[2*MAX_DONATIONS]; /* Queue of donated priorities */
+    struct heap held_locks;             /* Locks held, by highest donation. */
     struct lock* donated_lock;          /* Records the lock held by the donee */
     int nice;                           /* Niceness. */
     int32_t recent_cpu;                 /* Thread recent CPU usage. */
+    unsigned cpu_epoch;                 /* Second at which recent_cpu was last decayed. */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct malloc_cache malloc_cache;   /* Free blocks kept by malloc.c. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    struct heap_elem waitelem;          /* Semaphore waiter heap element. */
+    struct heap *wait_heap;             /* Heap to re-key on priority change. */
+    struct heap_elem *wait_elem;        /* Element of wait_heap to re-key. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -119,6 +134,18 @@ struct thread
     int exit_status;                    /* Return exit status. */
     struct hash children;               /* Hash table of child threads. */
     struct file *open_file;             /* Currently open file. */
+    bool filesys_reader;                /* Holds the system calls' file
+                                           system lock for reading? */
+#endif
+
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash pages;                  /* Supplemental page table. */
+    struct lock pages_lock;             /* Guards pages and their frames. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Identifier for the next mapping. */
 #endif
 
     /* Owned by thread.c. */
@@ -148,6 +175,8 @@ void thread_start (void);
 size_t threads_ready (void);
 
 void thread_tick (void);
+void thread_tick_idle (int64_t ticks);
+bool thread_refresh_pending (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -156,12 +185,6 @@ tid_t thread_create (const char *name, int priority, thread_func *, void *);
 void thread_block (void);
 void thread_unblock (struct thread *);
 
-bool prio_compare (const struct list_elem *a,
-                  const struct list_elem *b,
-                  void *aux UNUSED);
-bool compare_max_prio (const struct list_elem *a,
-                  const struct list_elem *b,
-                  void *aux UNUSED);
 void check_prio (int prio);
 
 struct thread *thread_current (void);
@@ -178,7 +201,8 @@ void thread_foreach (thread_action_func *, void *);
 int thread_get_priority (void);
 void thread_set_priority (int);
 
-void donate_priority (struct lock *lock, struct donated_prio *p);
+void donate_priority (struct lock *lock, int priority);
+void inherit_priority (struct lock *lock);
 void revoke_priority (struct lock *lock);
 
 int thread_get_nice (void);
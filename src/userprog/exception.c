@@ -2,9 +2,14 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/process.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -146,9 +151,31 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* Bring in a page of the process that is not in memory, or grow
+     its stack down to the address, whether the process itself or
+     the kernel, on its behalf, touched it.  Either way, the user
+     stack pointer is the one saved on entry to the kernel. */
+  if (not_present && is_user_vaddr (fault_addr)
+      && (page_fault_in (fault_addr)
+          || page_grow_stack (fault_addr, process_user_frame ()->esp)))
+    return;
+
+  /* Give the process its own copy of a copy-on-write page that it,
+     or the kernel on its behalf, wrote to. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && page_copy_on_write (fault_addr))
+    return;
+
+  /* The kernel, touching user memory on the process's behalf, hit
+     an address the process may not use or found no frame for it.
+     That is the process's failure, not a kernel bug.  System calls
+     pin user memory before taking any lock, so this is a last
+     resort that should only be reached with none held. */
+  if (!user && is_user_vaddr (fault_addr))
+    thread_exit_safe (EXCEPTION_CODE);
+#endif
+
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
@@ -0,0 +1,144 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* A queue of threads sleeping on one user word.  Queues exist
+   only while some thread is waiting on them. */
+struct futex
+  {
+    struct hash_elem elem;      /* Element in `futexes'. */
+    uint32_t *pagedir;          /* Address space of the word. */
+    int *uaddr;                 /* User virtual address of the word. */
+    struct condition waiters;   /* Sleeping threads, by priority. */
+    unsigned waiter_cnt;        /* Number of threads in `waiters'. */
+  };
+
+/* Futex queues, keyed by (pagedir, uaddr). */
+static struct hash futexes;
+
+/* Protects `futexes' and every queue in it.  A waiter checks its
+   word and goes to sleep while holding this lock, so a wake that
+   follows a change to the word can never be missed. */
+static struct lock futex_lock;
+
+static unsigned futex_hash (const struct hash_elem *, void *aux);
+static bool futex_less (const struct hash_elem *, const struct hash_elem *,
+                        void *aux);
+static struct futex *futex_lookup (uint32_t *pagedir, int *uaddr);
+
+/* Initializes the futex table. */
+void
+futex_init (void)
+{
+  hash_init (&futexes, futex_hash, futex_less, NULL);
+  lock_init (&futex_lock);
+}
+
+/* If the word at UADDR in the address space of PAGEDIR still
+   holds VAL, sleeps until woken by futex_wake() and returns
+   FUTEX_WOKEN.  Otherwise returns FUTEX_MISMATCH at once.  UADDR
+   must already have been validated as a mapped user address. */
+int
+futex_wait (uint32_t *pagedir, int *uaddr, int val)
+{
+  struct futex *f;
+
+  lock_acquire (&futex_lock);
+  if (*uaddr != val)
+    {
+      lock_release (&futex_lock);
+      return FUTEX_MISMATCH;
+    }
+
+  f = futex_lookup (pagedir, uaddr);
+  if (f == NULL)
+    {
+      f = malloc (sizeof *f);
+      if (f == NULL)
+        {
+          /* Behave as a spurious wakeup; the caller re-checks. */
+          lock_release (&futex_lock);
+          return FUTEX_WOKEN;
+        }
+      f->pagedir = pagedir;
+      f->uaddr = uaddr;
+      cond_init (&f->waiters);
+      f->waiter_cnt = 0;
+      hash_insert (&futexes, &f->elem);
+    }
+
+  f->waiter_cnt++;
+  cond_wait (&f->waiters, &futex_lock);
+  if (--f->waiter_cnt == 0)
+    {
+      hash_delete (&futexes, &f->elem);
+      free (f);
+    }
+  lock_release (&futex_lock);
+  return FUTEX_WOKEN;
+}
+
+/* Wakes up to CNT threads sleeping on the word at UADDR in the
+   address space of PAGEDIR, highest priority first, and returns
+   the number woken. */
+int
+futex_wake (uint32_t *pagedir, int *uaddr, int cnt)
+{
+  struct futex *f;
+  int woken = 0;
+
+  lock_acquire (&futex_lock);
+  f = futex_lookup (pagedir, uaddr);
+  if (f != NULL)
+    {
+      /* Waiters leave the queue only once they run again, so
+         count how many are still asleep rather than relying on
+         waiter_cnt. */
+      while (woken < cnt && !heap_empty (&f->waiters.waiters))
+        {
+          cond_signal (&f->waiters, &futex_lock);
+          woken++;
+        }
+    }
+  lock_release (&futex_lock);
+  return woken;
+}
+
+/* Returns the queue for (PAGEDIR, UADDR), or a null pointer if no
+   thread is waiting there. */
+static struct futex *
+futex_lookup (uint32_t *pagedir, int *uaddr)
+{
+  struct futex key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&futex_lock));
+
+  key.pagedir = pagedir;
+  key.uaddr = uaddr;
+  e = hash_find (&futexes, &key.elem);
+  return e != NULL ? hash_entry (e, struct futex, elem) : NULL;
+}
+
+/* Returns a hash of futex F's key. */
+static unsigned
+futex_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct futex *f = hash_entry (f_, struct futex, elem);
+  return hash_ptr (f->pagedir) ^ hash_ptr (f->uaddr);
+}
+
+/* Returns true if futex A's key precedes futex B's. */
+static bool
+futex_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct futex *a = hash_entry (a_, struct futex, elem);
+  const struct futex *b = hash_entry (b_, struct futex, elem);
+
+  if (a->pagedir != b->pagedir)
+    return a->pagedir < b->pagedir;
+  return a->uaddr < b->uaddr;
+}
@@ -0,0 +1,15 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Return values of futex_wait(). */
+#define FUTEX_WOKEN 0                 /* Slept and was woken. */
+#define FUTEX_MISMATCH -1             /* Word did not hold the expected value. */
+
+void futex_init (void);
+int futex_wait (uint32_t *pagedir, int *uaddr, int val);
+int futex_wake (uint32_t *pagedir, int *uaddr, int cnt);
+
+#endif /* userprog/futex.h */
@@ -19,13 +19,34 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
+
 static thread_func start_process NO_RETURN;
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+#endif
 static bool load (const char *cmdline, void (**eip) (void), void **esp, struct stack_entries* args);
 
+/* Cache of stack_entries, handed from process_execute() to the
+   new process's start_process(). */
+static struct kmem_cache stack_entries_cache;
+
+/* Initializes the process module. */
+void
+process_init (void)
+{
+  kmem_cache_init (&stack_entries_cache, "stack_entries",
+                   sizeof (struct stack_entries), NULL);
+}
+
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
@@ -47,9 +68,9 @@ process_execute (const char *file_name, struct exec_waiter *waiter)
   char *save_ptr;
   char *prog_name  = strtok_r((char *) fn_copy, SPACE_DELIM, (char **) &save_ptr);
 
-  struct stack_entries* args = malloc(sizeof(struct stack_entries));
+  struct stack_entries* args = kmem_cache_alloc(&stack_entries_cache);
   if (args == NULL) {
-    free(fn_copy);
+    palloc_free_page(fn_copy);
     return TID_ERROR;
   }
 
@@ -60,7 +81,8 @@ process_execute (const char *file_name, struct exec_waiter *waiter)
     args->argv[i] = argument;
     i++;
     if (i >= MAX_ARGUMENTS) {
-      free(args);
+      palloc_free_page(fn_copy);
+      kmem_cache_free(&stack_entries_cache, args);
       return TID_ERROR;
     }
   }
@@ -74,7 +96,7 @@ process_execute (const char *file_name, struct exec_waiter *waiter)
   /* Ensure dynamically allocated data is freed is thread_create fails. */
   if (tid == TID_ERROR) {
     palloc_free_page (fn_copy);
-    free(args);
+    kmem_cache_free(&stack_entries_cache, args);
   }
 
   return tid;
@@ -100,7 +122,7 @@ start_process (void *args)
 
   /* Free all dynamically allocated data. */
   palloc_free_page (file_name);
-  free(args);
+  kmem_cache_free(&stack_entries_cache, args);
 
   /* If a parent is waiting, set the load status and wake the thread. */
   if (waiter != NULL) {
@@ -123,6 +145,96 @@ start_process (void *args)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Handed from process_fork() to the child's start_fork(). */
+struct fork_args
+  {
+    struct intr_frame if_;        /* Parent's user registers. */
+    struct thread *parent;        /* Process being copied. */
+    struct semaphore done;        /* Upped once the copy is made. */
+    bool success;                 /* True if the copy was made. */
+  };
+
+/* Starts a new thread running a copy of the running process,
+   which must have entered the kernel through a system call.  The
+   copy shares the process's memory copy-on-write and has its own
+   copy of each of its open files.  Returns the new process's
+   thread id, or TID_ERROR if it cannot be created.  The copy
+   returns 0 from the system call instead. */
+tid_t
+process_fork (void)
+{
+  struct thread *cur = thread_current ();
+  struct fork_args args;
+  tid_t tid;
+
+  args.if_ = *process_user_frame ();
+  args.parent = cur;
+  sema_init (&args.done, 0);
+  args.success = false;
+
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &args);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  /* The child copies our address space, so wait for it. */
+  sema_down (&args.done);
+  return args.success ? tid : TID_ERROR;
+}
+
+/* A thread function that copies the process that forked it and
+   starts the copy running. */
+static void
+start_fork (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *t = thread_current ();
+  struct thread *parent = args->parent;
+  struct intr_frame if_ = args->if_;
+  bool success = false;
+
+  /* Allocate and activate page directory. */
+  if (!page_table_init ())
+    goto done;
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    {
+      page_table_destroy ();
+      goto done;
+    }
+  process_activate ();
+
+  /* Keep our own hold on the executable. */
+  t->open_file = file_reopen (parent->open_file);
+  if (t->open_file == NULL)
+    goto done;
+  file_deny_write (t->open_file);
+
+  success = (page_table_copy (parent, parent->open_file, t->open_file)
+             && file_elems_copy (parent));
+
+ done:
+  args->success = success;
+  sema_up (&args->done);
+  if (!success)
+    thread_exit_safe (LOAD_FAILURE);
+
+  /* Return 0 from fork() in the child. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif
+
+/* Returns the user registers of the running process, which were
+   saved at the top of its kernel stack when it last entered the
+   kernel from user mode (see tss.c). */
+struct intr_frame *
+process_user_frame (void)
+{
+  return (struct intr_frame *) ((uint8_t *) thread_current () + PGSIZE) - 1;
+}
+
 /* Waits for thread TID to die and returns its exit status. 
  * If it was terminated by the kernel (i.e. killed due to an exception), 
  * returns -1.  
@@ -160,6 +272,14 @@ process_exit (void)
   pd = cur->pagedir;
   if (pd != NULL) 
     {
+#ifdef VM
+      /* Write back and unmap its mapped files, then free the
+         process's pages, and the frames holding them, while its
+         page directory still maps them. */
+      mmap_unmap_all ();
+      page_table_destroy ();
+#endif
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
@@ -273,9 +393,18 @@ load (const char *file_name, void (**eip) (void), void **esp, struct stack_entri
   int i;
 
   /* Allocate and activate page directory. */
+#ifdef VM
+  if (!page_table_init ())
+    goto done;
+#endif
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
-    goto done;
+    {
+#ifdef VM
+      page_table_destroy ();
+#endif
+      goto done;
+    }
   process_activate ();
 
   /* Open executable file. */
@@ -378,7 +507,9 @@ load (const char *file_name, void (**eip) (void), void **esp, struct stack_entri
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -437,6 +568,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With virtual memory, nothing is read here: each page is only
+   entered in the supplemental page table, and read in on its
+   first page fault.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -447,7 +582,9 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifndef VM
   file_seek (file, ofs);
+#endif
   while (read_bytes > 0 || zero_bytes > 0) 
     {
       /* Calculate how to fill this page.
@@ -456,6 +593,14 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
       
+#ifdef VM
+      /* Only record where the page comes from.  It is read in by
+         the page fault handler when first touched. */
+      if (page_create_file (upage, writable, file, ofs, page_read_bytes)
+          == NULL)
+        return false;
+      ofs += PGSIZE;
+#else
       /* Check if virtual page already allocated */
       struct thread *t = thread_current ();
       uint8_t *kpage = pagedir_get_page (t->pagedir, upage);
@@ -489,6 +634,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
         return false; 
       }
       memset (kpage + page_read_bytes, 0, page_zero_bytes);
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -506,10 +652,18 @@ setup_stack (void **esp, struct stack_entries* args)
   uint8_t *kpage;
   bool success = false;
 
+#ifdef VM
+  struct page *p = page_create (((uint8_t *) PHYS_BASE) - PGSIZE, true);
+  kpage = p != NULL ? page_pin (p, true) : NULL;
+  if (kpage != NULL)
+    {
+      success = true;
+#else
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
       success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
+#endif
       if (success) {
         *esp = PHYS_BASE;
 
@@ -537,11 +691,15 @@ setup_stack (void **esp, struct stack_entries* args)
       else {
         palloc_free_page (kpage);
       }
+#ifdef VM
+      page_unpin (p);
+#endif
     }
 
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -561,3 +719,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
@@ -1,6 +1,7 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 
 #define SPACE_DELIM " "
@@ -43,7 +44,12 @@ struct stack_entries
    struct exec_waiter *waiter;   /* Synchronization structure including a semaphore and return boolean. */
 };
 
+void process_init (void);
 tid_t process_execute (const char *file_name, struct exec_waiter *waiter);
+#ifdef VM
+tid_t process_fork (void);
+#endif
+struct intr_frame *process_user_frame (void);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
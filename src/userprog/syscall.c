@@ -8,20 +8,46 @@
 
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 
+#include "userprog/futex.h"
 #include "userprog/process.h"
 #include "userprog/syscall.h"
 
+#ifdef VM
+#include "vm/mmap.h"
+#endif
+
+/* Cache of file_elems, one per open file descriptor. */
+static struct kmem_cache file_elem_cache;
+
 /* Lock used by allocate_fd(). */
 static struct lock fd_lock;
 
-/* Lock used by system calls using the file system. */
-static struct lock filesys_lock;
+/* Lock used by system calls using the file system.  Calls that
+   only inspect the file system take it for reading.  It guards
+   the file system's directories and the files reached through
+   file descriptors; the data in a file is guarded by its inode.
+   So the write-back of mapped pages, through handles of their
+   own, on munmap() or eviction does not take it, and can safely
+   happen in a page fault taken while it is held. */
+static struct rwlock filesys_lock;
 
 static void syscall_handler (struct intr_frame *);
+static void filesys_acquire_read (void);
+static void filesys_release_read (void);
+static void check_buffer (void* buffer, unsigned size);
 static void validate_buffer (void* buffer, unsigned size);
+static void validate_writable_buffer (void* buffer, unsigned size);
+static unsigned validate_string (const char *str);
+static void release_buffer (void* buffer, unsigned size);
+#ifdef VM
+static void pin_buffer (void* buffer, unsigned size, bool write);
+static void unpin_pages (void* start, void* end);
+#endif
 
 static void write (stack_arg *args, stack_arg *return_value);
 static void exit (stack_arg *args, stack_arg *return_value UNUSED);
@@ -36,6 +62,14 @@ static void read (stack_arg *args, stack_arg *return_value);
 static void seek (stack_arg *args, stack_arg *return_value UNUSED);
 static void tell (stack_arg *args, stack_arg *return_value);
 static void close (stack_arg *args, stack_arg *return_value UNUSED);
+static void futex_wait_ (stack_arg *args, stack_arg *return_value);
+static void futex_wake_ (stack_arg *args, stack_arg *return_value);
+static void meminfo (stack_arg *args UNUSED, stack_arg *return_value UNUSED);
+#ifdef VM
+static void mmap (stack_arg *args, stack_arg *return_value);
+static void munmap (stack_arg *args, stack_arg *return_value UNUSED);
+static void fork (stack_arg *args UNUSED, stack_arg *return_value);
+#endif
 
 /* Enumeration of system call functions. */
 static handler sys_call_handlers[NUM_SYSCALLS] = {
@@ -52,13 +86,36 @@ static handler sys_call_handlers[NUM_SYSCALLS] = {
     seek,                   /* Change position in a file. */
     tell,                   /* Report current position in a file. */
     close,                  /* Close a file. */
+#ifdef VM
+    mmap,                   /* Map a file into memory. */
+    munmap,                 /* Remove a memory mapping. */
+#else
+    NULL,                   /* Map a file into memory. */
+    NULL,                   /* Remove a memory mapping. */
+#endif
+    NULL,                   /* Change the current directory. */
+    NULL,                   /* Create a directory. */
+    NULL,                   /* Reads a directory entry. */
+    NULL,                   /* Tests if a fd represents a directory. */
+    NULL,                   /* Returns the inode number for a fd. */
+    futex_wait_,            /* Sleep while a word holds a value. */
+    futex_wake_,            /* Wake threads sleeping on a word. */
+    meminfo,                /* Print kernel memory usage. */
+#ifdef VM
+    fork,                   /* Duplicate this process. */
+#else
+    NULL,                   /* Duplicate this process. */
+#endif
 };
 
 void
 syscall_init (void)
 {
   lock_init(&fd_lock);
-  lock_init(&filesys_lock);
+  kmem_cache_init(&file_elem_cache, "file_elem", sizeof (struct file_elem),
+                  NULL);
+  rwlock_init(&filesys_lock);
+  futex_init();
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -70,7 +127,8 @@ syscall_handler (struct intr_frame *f)
     stack_arg sys_call_number;
     get_argument (sys_call_number, stack_pointer, stack_arg);
 
-    if (sys_call_number <= SYS_CLOSE) {
+    if (sys_call_number < NUM_SYSCALLS
+        && sys_call_handlers[sys_call_number] != NULL) {
       /* Invoked the handler corresponding to the system call number */
       sys_call_handlers[sys_call_number](stack_pointer, &f->eax);
     } else {
@@ -83,6 +141,23 @@ syscall_handler (struct intr_frame *f)
   }
 }
 
+/* Takes filesys_lock for reading, noting that the running thread
+   holds it so that thread_exit_safe() can release it. */
+static void
+filesys_acquire_read (void)
+{
+  rwlock_acquire_read(&filesys_lock);
+  thread_current()->filesys_reader = true;
+}
+
+/* Releases filesys_lock, held for reading by the running thread. */
+static void
+filesys_release_read (void)
+{
+  thread_current()->filesys_reader = false;
+  rwlock_release_read(&filesys_lock);
+}
+
 /* Returns a file descriptor to use for a new file. */
 static int
 allocate_fd (void)
@@ -128,6 +203,48 @@ file_lookup (const int fd)
   return e != NULL ? hash_entry (e, struct file_elem, hash_elem)->faddr : NULL;
 }
 
+/* Frees a file_elem, which must no longer be in any hash table. */
+void
+file_elem_free (struct file_elem *f)
+{
+  kmem_cache_free(&file_elem_cache, f);
+}
+
+/* Gives the running thread, a new child of PARENT, its own copy
+   of each file PARENT has open, under the same descriptor and at
+   the same position.  Returns false if memory is short. */
+bool
+file_elems_copy (struct thread *parent)
+{
+  struct thread *t = thread_current();
+  struct hash_iterator i;
+  bool success = true;
+
+  rwlock_acquire_write(&filesys_lock);
+  hash_first(&i, &parent->files);
+  while (hash_next(&i)) {
+    struct file_elem *f = hash_entry (hash_cur(&i), struct file_elem,
+                                      hash_elem);
+    struct file_elem *copy = kmem_cache_alloc(&file_elem_cache);
+
+    if (copy == NULL) {
+      success = false;
+      break;
+    }
+    copy->fd = f->fd;
+    copy->faddr = file_reopen(f->faddr);
+    if (copy->faddr == NULL) {
+      file_elem_free(copy);
+      success = false;
+      break;
+    }
+    file_seek(copy->faddr, file_tell(f->faddr));
+    hash_insert(&t->files, &copy->hash_elem);
+  }
+  rwlock_release_write(&filesys_lock);
+  return success;
+}
+
 /* Removes a file from the file system given its name. */
 /* SIGNATURE: bool remove (const char *file) */
 static void
@@ -135,11 +252,12 @@ remove (stack_arg *args, stack_arg *return_value)
 {
   char *name;
   get_argument(name, args, char *);
-  validate_pointer(name);
+  unsigned name_size = validate_string(name);
 
-  lock_acquire(&filesys_lock);
+  rwlock_acquire_write(&filesys_lock);
   bool returnStatus = filesys_remove((const char *) name);
-  lock_release(&filesys_lock);
+  rwlock_release_write(&filesys_lock);
+  release_buffer(name, name_size);
 
   *return_value = returnStatus;
 }
@@ -155,11 +273,12 @@ create (stack_arg *args, stack_arg *return_value)
   get_argument(name, args, char *);
   get_argument(initial_size, args, unsigned);
 
-  validate_pointer(name);
+  unsigned name_size = validate_string(name);
 
-  lock_acquire(&filesys_lock);
+  rwlock_acquire_write(&filesys_lock);
   bool returnStatus = filesys_create((const char *) name, initial_size);
-  lock_release(&filesys_lock);
+  rwlock_release_write(&filesys_lock);
+  release_buffer(name, name_size);
 
   *return_value = returnStatus;
 }
@@ -185,7 +304,7 @@ close (stack_arg *args, stack_arg *return_value UNUSED)
     /* Free dynamically allocated file element we've just removed */
     struct file_elem *fe = hash_entry(e, struct file_elem, hash_elem);
     file_close(fe->faddr);
-    free(fe);
+    file_elem_free(fe);
   }
 }
 
@@ -196,13 +315,14 @@ open (stack_arg *args, stack_arg *return_value)
 {
   char *file;
   get_argument(file, args, char *);
-  validate_pointer(file);
+  unsigned file_size = validate_string(file);
 
   struct thread *t = thread_current();
 
-  lock_acquire(&filesys_lock);
+  rwlock_acquire_write(&filesys_lock);
   struct file *faddr = filesys_open((const char *) file);
-  lock_release(&filesys_lock);
+  rwlock_release_write(&filesys_lock);
+  release_buffer(file, file_size);
 
   /* The failure return value for filesys_open is NULL. */
   if (faddr == NULL) {
@@ -210,13 +330,13 @@ open (stack_arg *args, stack_arg *return_value)
     return;
   }
 
-  struct file_elem *f = malloc(sizeof(struct file_elem));
+  struct file_elem *f = kmem_cache_alloc(&file_elem_cache);
   f->faddr = faddr;
   f->fd = allocate_fd();
 
   struct hash_elem *res = hash_insert(&t->files, &f->hash_elem);
   if (res != NULL) {
-    free(f);
+    file_elem_free(f);
   }
 
   *return_value = f->fd;
@@ -230,16 +350,16 @@ filesize (stack_arg *args, stack_arg *return_value)
   int fd;
   get_argument(fd, args, int);
 
-  lock_acquire(&filesys_lock);
+  filesys_acquire_read();
   struct file *f = file_lookup(fd);
 
   if (f == NULL) {
-    lock_release(&filesys_lock);
+    filesys_release_read();
     return;
   }
 
   *return_value = (unsigned) file_length(f);
-  lock_release(&filesys_lock);
+  filesys_release_read();
 }
 
 /* Changes a file's read-write position based on its fd. */
@@ -252,16 +372,16 @@ seek (stack_arg *args, stack_arg *return_value UNUSED)
   get_argument(fd, args, int);
   get_argument(position, args, unsigned);
 
-  lock_acquire(&filesys_lock);
+  rwlock_acquire_write(&filesys_lock);
   struct file *f = file_lookup(fd);
 
   if (f == NULL) {
-    lock_release(&filesys_lock);
+    rwlock_release_write(&filesys_lock);
     return;
   }
 
   file_seek(f, position);
-  lock_release(&filesys_lock);
+  rwlock_release_write(&filesys_lock);
 }
 
 /* Returns the next read-write position of a file. */
@@ -272,16 +392,16 @@ tell (stack_arg *args, stack_arg *return_value)
   int fd;
   get_argument(fd, args, int);
 
-  lock_acquire(&filesys_lock);
+  filesys_acquire_read();
   struct file *f = file_lookup(fd);
 
   if (f == NULL) {
-    lock_release(&filesys_lock);
+    filesys_release_read();
     return;
   }
 
   *return_value = (unsigned) file_tell(f);
-  lock_release(&filesys_lock);
+  filesys_release_read();
 }
 
 /* Safely exits a thread by releasing its userprog locks and
@@ -292,8 +412,10 @@ void thread_exit_safe(int status) {
 
   if (lock_held_by_current_thread(&fd_lock))
     lock_release(&fd_lock);
-  if (lock_held_by_current_thread(&filesys_lock))
-    lock_release(&filesys_lock);
+  if (rwlock_held_for_write(&filesys_lock))
+    rwlock_release_write(&filesys_lock);
+  if (cur->filesys_reader)
+    filesys_release_read();
 
   thread_exit();
 }
@@ -310,7 +432,7 @@ exit (stack_arg *args, stack_arg *return_value UNUSED)
 /* Checks if a multipage buffer can be safely accessed by the user,
    if not terminates the user process.                            */
 static void
-validate_buffer (void *buffer, unsigned size)
+check_buffer (void *buffer, unsigned size)
 {
   validate_pointer(buffer);
 
@@ -321,6 +443,112 @@ validate_buffer (void *buffer, unsigned size)
   validate_pointer(end - 1);
 }
 
+/* Checks that a multipage buffer can be safely read by the kernel
+   on the user's behalf, if not terminates the user process.  The
+   buffer is then kept in memory until release_buffer(), so that
+   the kernel never faults on it while holding a lock. */
+static void
+validate_buffer (void *buffer, unsigned size)
+{
+  check_buffer(buffer, size);
+#ifdef VM
+  pin_buffer(buffer, size, false);
+#endif
+}
+
+/* Checks that a multipage buffer can be safely written by the
+   kernel on the user's behalf, if not terminates the user process.
+   The buffer is then kept in memory, as by validate_buffer(). */
+static void
+validate_writable_buffer (void *buffer, unsigned size)
+{
+  struct thread *cur = thread_current();
+
+  check_buffer(buffer, size);
+
+  void *end = buffer + size;
+  for (void *cur_ptr = pg_round_down(buffer); cur_ptr < end;
+       cur_ptr += PAGE_SIZE) {
+#ifdef VM
+    if (!page_lookup(cur, cur_ptr)->writable)
+#else
+    if (!pagedir_is_writable(cur->pagedir, cur_ptr))
+#endif
+      thread_exit_safe(SYSCALL_ERROR);
+  }
+#ifdef VM
+  pin_buffer(buffer, size, true);
+#endif
+}
+
+/* Checks that a null-terminated string can be safely read by the
+   kernel on the user's behalf, if not terminates the user process,
+   and keeps it in memory as validate_buffer() does.  Returns the
+   size of the string, including its terminator, to pass to
+   release_buffer(). */
+static unsigned
+validate_string (const char *str)
+{
+  const char *cur_ptr = str;
+
+  /* Finding the end may fault the string in, but no lock is held
+     yet. */
+  validate_pointer((void *) str);
+  while (*cur_ptr != '\0') {
+    cur_ptr++;
+    if (pg_ofs(cur_ptr) == 0)
+      validate_pointer((void *) cur_ptr);
+  }
+
+  unsigned size = cur_ptr - str + 1;
+#ifdef VM
+  pin_buffer((void *) str, size, false);
+#endif
+  return size;
+}
+
+/* Releases a buffer kept in memory by validate_buffer(),
+   validate_writable_buffer() or validate_string(). */
+static void
+release_buffer (void *buffer UNUSED, unsigned size UNUSED)
+{
+#ifdef VM
+  if (size > 0)
+    unpin_pages(pg_round_down(buffer), buffer + size);
+#endif
+}
+
+#ifdef VM
+/* Brings every page of a checked buffer into memory and pins it
+   there, giving copy-on-write pages their own copy first if WRITE
+   is true.  Terminates the user process if no frame is available,
+   while it holds no lock. */
+static void
+pin_buffer (void *buffer, unsigned size, bool write)
+{
+  struct thread *cur = thread_current();
+  void *start = pg_round_down(buffer);
+  void *end = buffer + size;
+
+  for (void *cur_ptr = start; cur_ptr < end; cur_ptr += PAGE_SIZE) {
+    if (page_pin(page_lookup(cur, cur_ptr), write) == NULL) {
+      unpin_pages(start, cur_ptr);
+      thread_exit_safe(SYSCALL_ERROR);
+    }
+  }
+}
+
+/* Unpins the pages from START, which is page-aligned, up to END. */
+static void
+unpin_pages (void *start, void *end)
+{
+  struct thread *cur = thread_current();
+
+  for (void *cur_ptr = start; cur_ptr < end; cur_ptr += PAGE_SIZE)
+    page_unpin(page_lookup(cur, cur_ptr));
+}
+#endif
+
 /* SIGNATURE: int read (int fd, const void *buffer, unsigned size) */
 static void
 read (stack_arg *args, stack_arg *return_value)
@@ -333,7 +561,7 @@ read (stack_arg *args, stack_arg *return_value)
   get_argument(buffer, args, void *);
   get_argument(size, args, unsigned );
 
-  validate_buffer(buffer, size);
+  validate_writable_buffer(buffer, size);
 
   /* Read from standard input. */
   if (fd == STDIN_FILENO) {
@@ -346,24 +574,27 @@ read (stack_arg *args, stack_arg *return_value)
     }
 
     *return_value = inputs_read;
+    release_buffer(buffer, size);
     return;
   }
 
   /* Read from keyboard. */
-  lock_acquire(&filesys_lock);
+  filesys_acquire_read();
 
   struct file *f = file_lookup(fd);
 
   if (f == NULL) {
     *return_value = 0;
-    lock_release(&filesys_lock);
+    filesys_release_read();
+    release_buffer(buffer, size);
     return;
   }
 
   off_t amount_read = file_read(f, buffer, size);
   *return_value = (unsigned) amount_read;
 
-  lock_release(&filesys_lock);
+  filesys_release_read();
+  release_buffer(buffer, size);
 }
 
 /* System write call from a buffer to a file associated with a given fd. */
@@ -394,24 +625,27 @@ write (stack_arg *args, stack_arg *return_value)
     }
 
     *return_value = (int) size;
+    release_buffer(buffer, size);
     return;
   }
 
   /* Write to file. */
-  lock_acquire(&filesys_lock);
+  rwlock_acquire_write(&filesys_lock);
 
   struct file *f = file_lookup(fd);
 
   if (f == NULL) {
     *return_value = 0;
-    lock_release(&filesys_lock);
+    rwlock_release_write(&filesys_lock);
+    release_buffer(buffer, size);
     return;
   }
 
   off_t amount_written = file_write(f, buffer, size);
   *return_value = (int) amount_written;
 
-  lock_release(&filesys_lock);
+  rwlock_release_write(&filesys_lock);
+  release_buffer(buffer, size);
 }
 
 /* SIGNATURE: void halt (void) */
@@ -453,3 +687,103 @@ wait (stack_arg *args, stack_arg *return_value)
   get_argument(pid, args, tid_t);
   *return_value = process_wait(pid);
 }
+
+/* Checks that the word at UADDR is a mapped, aligned user address. */
+static void
+validate_futex (int *uaddr)
+{
+  if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+    thread_exit_safe(SYSCALL_ERROR);
+  validate_pointer(uaddr);
+}
+
+/* Sleeps while the word at an address holds a value. */
+/* SIGNATURE: int futex_wait (int *uaddr, int val) */
+static void
+futex_wait_ (stack_arg *args, stack_arg *return_value)
+{
+  int *uaddr;
+  int val;
+  get_argument(uaddr, args, int *);
+  get_argument(val, args, int);
+  validate_futex(uaddr);
+
+  /* futex_lock is held while the word is read, so keep it in
+     memory, at the cost of one pinned page while the thread
+     sleeps. */
+  validate_buffer(uaddr, sizeof *uaddr);
+  *return_value = futex_wait(thread_current()->pagedir, uaddr, val);
+  release_buffer(uaddr, sizeof *uaddr);
+}
+
+/* Wakes up to a given number of threads sleeping on a word. */
+/* SIGNATURE: int futex_wake (int *uaddr, int cnt) */
+static void
+futex_wake_ (stack_arg *args, stack_arg *return_value)
+{
+  int *uaddr;
+  int cnt;
+  get_argument(uaddr, args, int *);
+  get_argument(cnt, args, int);
+  validate_futex(uaddr);
+
+  *return_value = futex_wake(thread_current()->pagedir, uaddr, cnt);
+}
+
+/* Prints how much memory the kernel has handed out. */
+/* SIGNATURE: void meminfo (void) */
+static void
+meminfo (stack_arg *args UNUSED, stack_arg *return_value UNUSED)
+{
+  palloc_print_usage ();
+  malloc_print_usage ();
+}
+
+#ifdef VM
+/* Maps the file open as fd into memory at addr, returning a
+   mapping identifier. */
+/* SIGNATURE: mapid_t mmap (int fd, void *addr) */
+static void
+mmap (stack_arg *args, stack_arg *return_value)
+{
+  int fd;
+  void *addr;
+  get_argument(fd, args, int);
+  get_argument(addr, args, void *);
+
+  rwlock_acquire_write(&filesys_lock);
+  struct file *f = file_lookup(fd);
+
+  if (f == NULL) {
+    *return_value = MAPID_ERROR;
+    rwlock_release_write(&filesys_lock);
+    return;
+  }
+
+  *return_value = mmap_map(f, addr);
+  rwlock_release_write(&filesys_lock);
+}
+
+/* Unmaps a mapping made by mmap, writing back the pages written
+   through it.  The mapping has its own file handle, so this needs
+   no filesys_lock. */
+/* SIGNATURE: void munmap (mapid_t mapping) */
+static void
+munmap (stack_arg *args, stack_arg *return_value UNUSED)
+{
+  int mapping;
+  get_argument(mapping, args, int);
+
+  mmap_unmap(mapping);
+}
+
+/* Creates a child process that is a copy of this one, sharing
+   its memory copy-on-write.  Returns the child's pid to the
+   parent and 0 to the child. */
+/* SIGNATURE: pid_t fork (void) */
+static void
+fork (stack_arg *args UNUSED, stack_arg *return_value)
+{
+  *return_value = process_fork ();
+}
+#endif
@@ -10,6 +10,9 @@
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 #define PAGE_SIZE 0x1000 /* 4KB */
 
@@ -17,7 +20,7 @@
 #define FD_ERROR -1                         /* Error value for file descriptors. */
 #define FD_START 2                          /* Starting file descriptor to be allocated. */
 #define MAX_STDOUT_BUFF_SIZE 128            /* Maximum buffer size for stdout writes. */
-#define NUM_SYSCALLS 19                     /* Number of system calls. */
+#define NUM_SYSCALLS 24                     /* Number of system calls. */
 
 /* Stores the next argument on the stack into the provided variable */
 #define get_argument(var_name, arg_ptr, type) \
@@ -50,6 +53,8 @@ struct file_elem
 unsigned file_elem_hash (const struct hash_elem *, void *aux);
 bool file_elem_less (const struct hash_elem *, const struct hash_elem *, void *aux);
 struct file *file_lookup (const int);
+void file_elem_free (struct file_elem *);
+bool file_elems_copy (struct thread *parent);
 void syscall_init (void);
 void thread_exit_safe (int);
 
@@ -57,7 +62,15 @@ void thread_exit_safe (int);
 inline static void
 validate_pointer (void *ptr)
 {
+#ifdef VM
+  /* The page need not be in memory; the kernel faults it in.  A
+     pointer just below the stack may need the stack grown first. */
+  if (ptr == NULL || !is_user_vaddr(ptr)
+      || (page_lookup(thread_current(), ptr) == NULL
+          && !page_grow_stack(ptr, process_user_frame()->esp))) {
+#else
   if (ptr == NULL || !is_user_vaddr(ptr) || pagedir_get_page(thread_current()->pagedir, ptr) == NULL) {
+#endif
     thread_exit_safe(SYSCALL_ERROR);
   }
 }
@@ -0,0 +1,247 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/share.h"
+
+/* Frame table.
+
+   All frames in use are kept on one list, which the clock hand
+   sweeps round when a frame must be evicted.  A frame whose page
+   was accessed since the hand last passed has its accessed bit
+   cleared and gets a second chance; the first frame found that
+   was not accessed, and is neither pinned nor owned by a process
+   whose page table is busy, is the victim.  A frame holding a
+   shared page counts as accessed if any of the processes mapping
+   it accessed it.
+
+   frame_lock guards the list, the hand and every frame's `page'
+   and `pin_cnt' members.  Pins nest, so that a shared frame
+   pinned by several processes at once stays put until the last
+   of them unpins it.  It is never held while sleeping on
+   anything else, so eviction writes the victim out after
+   releasing it, with the victim's frame pinned and its owner's
+   pages_lock, or for a shared page the share lock, held
+   instead. */
+
+static struct list frames;              /* All frames, in clock order. */
+static struct list_elem *hand;          /* Next frame the clock examines. */
+static struct lock frame_lock;          /* Guards the above. */
+
+/* Cache of struct frames. */
+static struct kmem_cache frame_cache;
+
+static struct frame *pick_victim (void);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frames);
+  hand = list_end (&frames);
+  lock_init (&frame_lock);
+  kmem_cache_init (&frame_cache, "frame", sizeof (struct frame), NULL);
+}
+
+/* Obtains a frame from the user pool to hold PAGE, evicting
+   another page if the pool is empty, and returns it pinned.  If
+   FLAGS includes PAL_ZERO, the frame is zeroed.  Returns a null
+   pointer if no frame can be found.  The running thread must
+   hold its own pages_lock.  A frame for a shared page is
+   allocated with a null PAGE, and the caller sets its SHARE. */
+struct frame *
+frame_alloc (struct page *page, enum palloc_flags flags)
+{
+  struct frame *f;
+  struct page *victim;
+  bool evicted;
+
+  ASSERT (lock_held_by_current_thread (&thread_current ()->pages_lock));
+
+  f = frame_try_alloc (page, flags);
+  if (f != NULL)
+    return f;
+
+  /* The user pool is empty, so take a frame from another page. */
+  lock_acquire (&frame_lock);
+  f = pick_victim ();
+  if (f != NULL)
+    f->pin_cnt = 1;
+  lock_release (&frame_lock);
+  if (f == NULL)
+    return NULL;
+
+  if (f->share != NULL)
+    evicted = share_evict (f->share);
+  else
+    {
+      victim = f->page;
+      evicted = page_evict (victim);
+      if (victim->owner != thread_current ())
+        lock_release (&victim->owner->pages_lock);
+    }
+  if (!evicted)
+    {
+      frame_unpin (f);
+      return NULL;
+    }
+
+  lock_acquire (&frame_lock);
+  f->page = page;
+  f->share = NULL;
+  lock_release (&frame_lock);
+  if (flags & PAL_ZERO)
+    memset (f->kpage, 0, PGSIZE);
+  return f;
+}
+
+/* Obtains a free frame from the user pool to hold PAGE, as
+   frame_alloc(), but returns a null pointer rather than evicting
+   another page if the pool is empty. */
+struct frame *
+frame_try_alloc (struct page *page, enum palloc_flags flags)
+{
+  struct frame *f;
+  void *kpage;
+
+  kpage = palloc_get_page (PAL_USER | flags);
+  if (kpage == NULL)
+    return NULL;
+
+  f = kmem_cache_alloc (&frame_cache);
+  if (f == NULL)
+    {
+      palloc_free_page (kpage);
+      return NULL;
+    }
+  f->kpage = kpage;
+  f->page = page;
+  f->share = NULL;
+  f->pin_cnt = 1;
+
+  lock_acquire (&frame_lock);
+  list_push_back (&frames, &f->elem);
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Removes F from the frame table and frees its page.  F's page
+   must already have been unmapped, and its owner's pages_lock,
+   or for a shared page the share lock, must be held. */
+void
+frame_free (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  if (hand == &f->elem)
+    hand = list_next (hand);
+  list_remove (&f->elem);
+  lock_release (&frame_lock);
+
+  palloc_free_page (f->kpage);
+  kmem_cache_free (&frame_cache, f);
+}
+
+/* Records that F now holds PAGE or, if PAGE is null, SHARE.  The
+   caller must have F pinned, or hold the lock that the clock
+   would need to evict it. */
+void
+frame_assign (struct frame *f, struct page *page, struct share *share)
+{
+  ASSERT ((page == NULL) != (share == NULL));
+
+  lock_acquire (&frame_lock);
+  f->page = page;
+  f->share = share;
+  lock_release (&frame_lock);
+}
+
+/* Prevents F from being evicted until a matching frame_unpin(). */
+void
+frame_pin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  f->pin_cnt++;
+  lock_release (&frame_lock);
+}
+
+/* Pins F, as frame_pin(), unless it is already pinned.  Returns
+   true if it was pinned by this call. */
+bool
+frame_try_pin (struct frame *f)
+{
+  bool success;
+
+  lock_acquire (&frame_lock);
+  success = f->pin_cnt == 0;
+  if (success)
+    f->pin_cnt = 1;
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* Drops one pin on F, allowing it to be evicted again once no
+   pins are left. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Advances the clock hand until it finds a frame to evict, and
+   returns that frame with its owner's pages_lock held (unless the
+   owner is the running thread, which already holds it), or for a
+   shared page with the share lock held by share_select().  Returns
+   a null pointer if two full turns find nothing.  frame_lock
+   must be held. */
+static struct frame *
+pick_victim (void)
+{
+  size_t steps = 2 * list_size (&frames) + 1;
+
+  while (steps-- > 0)
+    {
+      struct frame *f;
+      struct page *p;
+      uint32_t *pd;
+
+      if (hand == list_end (&frames))
+        {
+          hand = list_begin (&frames);
+          if (hand == list_end (&frames))
+            return NULL;
+        }
+      f = list_entry (hand, struct frame, elem);
+      hand = list_next (hand);
+
+      if (f->pin_cnt > 0)
+        continue;
+      if (f->share != NULL)
+        {
+          if (share_select (f->share))
+            return f;
+          continue;
+        }
+
+      /* Give recently used pages a second chance. */
+      p = f->page;
+      pd = p->owner->pagedir;
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          pagedir_set_accessed (pd, p->upage, false);
+          continue;
+        }
+
+      if (p->owner == thread_current ()
+          || lock_try_acquire (&p->owner->pages_lock))
+        return f;
+    }
+  return NULL;
+}
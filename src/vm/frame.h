@@ -0,0 +1,39 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+#include "threads/palloc.h"
+
+struct page;
+struct share;
+
+/* A frame: one page of the user pool holding a user page.
+
+   Every user-pool page that backs a process's virtual memory is
+   described by a frame in the frame table.  When the user pool
+   runs dry, frame_alloc() takes a frame away from whichever page
+   the clock algorithm picks and writes that page out first.  A
+   pinned frame is never chosen. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address of the page. */
+    struct page *page;          /* Page held, which names its owner
+                                   and user virtual address, or
+                                   null if SHARE is set. */
+    struct share *share;        /* Shared page held, or null. */
+    unsigned pin_cnt;           /* Number of pins held; never evicted
+                                   while nonzero. */
+    struct list_elem elem;      /* Element in the frame table. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *, enum palloc_flags);
+struct frame *frame_try_alloc (struct page *, enum palloc_flags);
+void frame_free (struct frame *);
+void frame_assign (struct frame *, struct page *, struct share *);
+void frame_pin (struct frame *);
+bool frame_try_pin (struct frame *);
+void frame_unpin (struct frame *);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,116 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+static void unmap (struct mapping *);
+
+/* Maps FILE into the running process's memory at ADDR, which
+   must be page-aligned and not null, using a handle of its own so
+   that the mapping outlives FILE.  The pages the file would cover
+   must be user pages the process does not already have.  Returns
+   the new mapping's identifier, or MAPID_ERROR if FILE is empty,
+   ADDR is unsuitable or memory is short. */
+int
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  uint8_t *upage;
+  off_t length;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return MAPID_ERROR;
+  length = file_length (file);
+  if (length == 0)
+    return MAPID_ERROR;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAPID_ERROR;
+  m->addr = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+  for (i = 0, upage = addr; i < m->page_cnt; i++, upage += PGSIZE)
+    if (!is_user_vaddr (upage) || page_lookup (t, upage) != NULL)
+      {
+        free (m);
+        return MAPID_ERROR;
+      }
+
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAPID_ERROR;
+    }
+
+  for (i = 0, upage = addr; i < m->page_cnt; i++, upage += PGSIZE)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (page_create_mapped (upage, m->file, ofs, read_bytes) == NULL)
+        {
+          /* Undo the pages created so far. */
+          m->page_cnt = i;
+          unmap (m);
+          return MAPID_ERROR;
+        }
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+}
+
+/* Unmaps the running process's mapping with identifier ID, if it
+   has one, writing back the pages it changed. */
+void
+mmap_unmap (int id)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == id)
+        {
+          list_remove (&m->elem);
+          unmap (m);
+          return;
+        }
+    }
+}
+
+/* Unmaps all of the running process's mappings, as it exits. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_pop_front (&t->mappings), struct mapping, elem));
+}
+
+/* Removes M's pages from the running process's page table,
+   writing back those that changed, and frees M. */
+static void
+unmap (struct mapping *m)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = m->addr;
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++, upage += PGSIZE)
+    page_remove (page_lookup (t, upage));
+  file_close (m->file);
+  free (m);
+}
@@ -0,0 +1,30 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <list.h>
+#include <stddef.h>
+
+struct file;
+
+#define MAPID_ERROR -1          /* Error value for mapping identifiers. */
+
+/* A file mapped into a process's memory by the mmap system call.
+
+   Each page of the mapping is a page in the process's
+   supplemental page table that is read from the file when first
+   touched, and written back to it, if changed, when evicted or
+   unmapped. */
+struct mapping
+  {
+    int id;                     /* Mapping identifier. */
+    struct file *file;          /* The mapping's own handle on the file. */
+    void *addr;                 /* First mapped page. */
+    size_t page_cnt;            /* Number of pages mapped. */
+    struct list_elem elem;      /* Element in the process's mappings. */
+  };
+
+int mmap_map (struct file *, void *addr);
+void mmap_unmap (int id);
+void mmap_unmap_all (void);
+
+#endif /* vm/mmap.h */
@@ -0,0 +1,652 @@
+#include "vm/page.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <string.h>
+#include "devices/swap.h"
+#include "filesys/file.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/share.h"
+
+/* Supplemental page table.
+
+   A process's pages are created when it is loaded and as its
+   stack is set up, and stay in its page table until it exits.
+   A page is in one of four places: in a frame, mapped in the
+   process's page directory; in a swap slot, after eviction; in
+   the executable file, for a segment page not yet touched or
+   never written; or nowhere yet, in which case it reads as
+   zeros.  page_fault_in() brings a page that is not in a frame
+   back into one, so a process only reads in the parts of its
+   executable that it uses.  A page read from the file that is
+   still clean when evicted is simply dropped and read again
+   later; once written, it goes to swap like any other.  A page
+   of a file mapped with mmap is instead written back to its file
+   whenever it is evicted or unmapped after being written.  A
+   read-only page of the executable instead maps a copy shared
+   with every other process running it, and a forked process's
+   pages share their contents with its parent's until either
+   writes to them (see share.c).
+
+   Pages go to swap in clusters: the pages following an evicted
+   page in the same process that are also idle and must go to
+   swap are written with it, to consecutive slots, in one
+   request, and faulting any of them in reads back as many of
+   the slots after it as there are free frames for.
+
+   Only the owner adds or removes pages, so the owner may look a
+   page up without taking pages_lock.  Anything that moves a page
+   in or out of a frame holds the owner's pages_lock. */
+
+/* Maximum number of pages in a process's stack, 8 MB by default.
+   Set by the -sl kernel command-line option. */
+size_t stack_page_limit = 2048;
+
+/* Cache of struct pages. */
+static struct kmem_cache page_cache;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+static bool page_load (struct page *);
+static size_t page_gather_evict (struct page *, struct page *cluster[]);
+static size_t page_gather_load (struct page *, struct frame *frames[]);
+static void page_write_back (struct page *);
+
+/* Initializes the page module. */
+void
+page_init (void)
+{
+  kmem_cache_init (&page_cache, "page", sizeof (struct page), NULL);
+}
+
+/* Creates an empty page table for the running thread.  Returns
+   false if memory is short. */
+bool
+page_table_init (void)
+{
+  struct thread *t = thread_current ();
+
+  lock_init (&t->pages_lock);
+  return hash_init (&t->pages, page_hash, page_less, NULL);
+}
+
+/* Frees every page in the running thread's page table, along
+   with the frames and swap slots holding them. */
+void
+page_table_destroy (void)
+{
+  struct thread *t = thread_current ();
+
+  lock_acquire (&t->pages_lock);
+  hash_destroy (&t->pages, page_destroy);
+  lock_release (&t->pages_lock);
+}
+
+/* Gives the running thread, a new child of PARENT, a copy of each
+   of PARENT's pages, other than those of its mapped files.  Pages
+   in memory or in swap become copy-on-write, with both processes
+   mapping one copy read-only until either writes to it.  Pages
+   not yet read from a file are read by each process separately,
+   from FILE where PARENT would read from PARENT_FILE.  Returns
+   false if memory is short. */
+bool
+page_table_copy (struct thread *parent, struct file *parent_file,
+                 struct file *file)
+{
+  struct hash_iterator i;
+  bool success = true;
+
+  lock_acquire (&parent->pages_lock);
+  hash_first (&i, &parent->pages);
+  while (success && hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, elem);
+      struct page *p;
+
+      if (pp->mapped)
+        continue;
+      p = page_create (pp->upage, pp->writable);
+      if (p == NULL)
+        success = false;
+      else if (pp->share != NULL || pp->frame != NULL
+               || pp->swap_slot != BITMAP_ERROR)
+        success = share_copy (pp, p);
+      else
+        {
+          p->file = pp->file == parent_file ? file : pp->file;
+          p->file_ofs = pp->file_ofs;
+          p->read_bytes = pp->read_bytes;
+        }
+    }
+  lock_release (&parent->pages_lock);
+  return success;
+}
+
+/* Adds a page at UPAGE, writable if WRITABLE is true, to the
+   running thread's page table and returns it.  The page reads as
+   zeros until written.  Returns a null pointer if UPAGE already
+   has a page or memory is short. */
+struct page *
+page_create (void *upage, bool writable)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  p = kmem_cache_alloc (&page_cache);
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->owner = t;
+  p->writable = writable;
+  p->frame = NULL;
+  p->swap_slot = BITMAP_ERROR;
+  p->file = NULL;
+  p->file_ofs = 0;
+  p->read_bytes = 0;
+  p->mapped = false;
+  p->share = NULL;
+
+  lock_acquire (&t->pages_lock);
+  if (hash_insert (&t->pages, &p->elem) != NULL)
+    {
+      kmem_cache_free (&page_cache, p);
+      p = NULL;
+    }
+  lock_release (&t->pages_lock);
+  return p;
+}
+
+/* Adds a page at UPAGE, writable if WRITABLE is true, to the
+   running thread's page table and returns it.  When first
+   touched, the page's first READ_BYTES bytes are read from FILE
+   at offset OFS and the rest are zeroed.  FILE must stay open
+   and unchanged for as long as the page exists.
+
+   A new read-only page shares one copy with every other process
+   mapping the same part of FILE.  If UPAGE already has a page,
+   because two segments share it, that page is redirected to FILE
+   instead, as though the later segment had been read over the
+   earlier one, and is writable if either segment is; such a page
+   is kept private.  Returns a null pointer if memory is short. */
+struct page *
+page_create_file (void *upage, bool writable, struct file *file, off_t ofs,
+                  size_t read_bytes)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  bool fresh = false;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = page_lookup (t, upage);
+  if (p == NULL)
+    {
+      p = page_create (upage, writable);
+      if (p == NULL)
+        return NULL;
+      fresh = true;
+    }
+
+  lock_acquire (&t->pages_lock);
+  if (p->share != NULL)
+    share_detach (p);
+  ASSERT (p->frame == NULL && p->swap_slot == BITMAP_ERROR);
+  p->writable = p->writable || writable;
+  p->file = read_bytes > 0 ? file : NULL;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+
+  /* If memory is short, the page just stays private. */
+  if (fresh && !writable && p->file != NULL)
+    share_attach (p, file, ofs, read_bytes);
+  lock_release (&t->pages_lock);
+  return p;
+}
+
+/* Adds a writable page at UPAGE to the running thread's page
+   table for part of a mapped file: READ_BYTES bytes of FILE at
+   offset OFS, followed by zeros.  The page is read in when first
+   touched, and written back to FILE when evicted or removed if
+   it was changed.  Returns a null pointer if UPAGE already has a
+   page or memory is short. */
+struct page *
+page_create_mapped (void *upage, struct file *file, off_t ofs,
+                    size_t read_bytes)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  /* No other thread looks at P until it is in a frame. */
+  p = page_create (upage, true);
+  if (p != NULL)
+    {
+      p->file = file;
+      p->file_ofs = ofs;
+      p->read_bytes = read_bytes;
+      p->mapped = true;
+    }
+  return p;
+}
+
+/* Removes P from the running thread's page table and frees it,
+   first writing it back to its file if it is a changed page of a
+   mapped file. */
+void
+page_remove (struct page *p)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (p->owner == t);
+
+  lock_acquire (&t->pages_lock);
+  hash_delete (&t->pages, &p->elem);
+  page_destroy (&p->elem, NULL);
+  lock_release (&t->pages_lock);
+}
+
+/* Returns the page of T's that contains UADDR, or a null pointer
+   if there is none.  Only T itself may call this without holding
+   T's pages_lock. */
+struct page *
+page_lookup (struct thread *t, const void *uaddr)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (uaddr);
+  e = hash_find (&t->pages, &p.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Brings P, a page of the running thread, into a frame if it is
+   not in one already, maps it, and keeps it there until
+   page_unpin(), so that the kernel can touch it without faulting.
+   A page that shares its contents has the shared frame pinned,
+   unless WRITE is true, in which case P first gets its own copy
+   as if it had been written.  Returns the frame's kernel virtual
+   address, or a null pointer if no frame is available. */
+void *
+page_pin (struct page *p, bool write)
+{
+  struct thread *t = thread_current ();
+  void *kpage = NULL;
+
+  ASSERT (p->owner == t);
+  ASSERT (!write || p->writable);
+
+  lock_acquire (&t->pages_lock);
+  if (write && p->share != NULL)
+    {
+      /* Map the shared frame and hold it in memory, for
+         share_write() to copy from. */
+      struct frame *shared;
+      bool copied;
+
+      if (share_pin (p) == NULL)
+        goto done;
+      shared = p->share->frame;
+      copied = share_write (p);
+      frame_unpin (shared);
+      if (!copied)
+        goto done;
+    }
+
+  if (p->share != NULL)
+    kpage = share_pin (p);
+  else
+    {
+      if (p->frame != NULL)
+        frame_pin (p->frame);
+      if (p->frame != NULL || page_load (p))
+        kpage = p->frame->kpage;
+    }
+
+ done:
+  lock_release (&t->pages_lock);
+  return kpage;
+}
+
+/* Allows P, pinned by page_pin(), to be evicted again. */
+void
+page_unpin (struct page *p)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (p->owner == t);
+
+  /* A pinned frame cannot be evicted, so P still has it. */
+  lock_acquire (&t->pages_lock);
+  if (p->share != NULL)
+    frame_unpin (p->share->frame);
+  else if (p->frame != NULL)
+    frame_unpin (p->frame);
+  lock_release (&t->pages_lock);
+}
+
+/* Handles a fault on FAULT_ADDR, a user address whose page is
+   not present, by bringing that page of the running thread into
+   a frame.  Returns false if the address has no page or no
+   frame is available. */
+bool
+page_fault_in (const void *fault_addr)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  bool success;
+
+  if (t->pagedir == NULL)
+    return false;
+
+  p = page_lookup (t, fault_addr);
+  if (p == NULL)
+    return false;
+
+  lock_acquire (&t->pages_lock);
+  success = true;
+  if (p->share != NULL)
+    success = share_fault_in (p);
+  else if (p->frame == NULL)
+    {
+      success = page_load (p);
+      if (success)
+        frame_unpin (p->frame);
+    }
+  lock_release (&t->pages_lock);
+  return success;
+}
+
+/* Handles a fault on FAULT_ADDR, a user address with no page, by
+   growing the running thread's stack down to it, if it looks like
+   a stack access.  That is, it must be no more than 32 bytes below
+   the user stack pointer ESP, as PUSHA writes, and no more than
+   stack_page_limit pages below the top of user memory.  Returns
+   false if the address is not a stack access or no frame is
+   available. */
+bool
+page_grow_stack (const void *fault_addr, const void *esp)
+{
+  struct thread *t = thread_current ();
+  void *upage = pg_round_down (fault_addr);
+
+  if (t->pagedir == NULL
+      || (uint8_t *) fault_addr + 32 < (uint8_t *) esp
+      || pg_no (PHYS_BASE) - pg_no (upage) > stack_page_limit)
+    return false;
+
+  return page_create (upage, true) != NULL && page_fault_in (upage);
+}
+
+/* Handles a write to FAULT_ADDR, a user address whose page is
+   mapped read-only, by giving the running thread its own copy of
+   the page if it is copy-on-write.  Returns false if the page
+   may not be written or no frame is available. */
+bool
+page_copy_on_write (const void *fault_addr)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  bool success;
+
+  if (t->pagedir == NULL)
+    return false;
+
+  p = page_lookup (t, fault_addr);
+  if (p == NULL || !p->writable || p->share == NULL)
+    return false;
+
+  lock_acquire (&t->pages_lock);
+  success = share_write (p);
+  lock_release (&t->pages_lock);
+  return success;
+}
+
+/* Unmaps P, whose frame the caller has pinned for eviction, and
+   writes it out to swap unless it can be read back from its file,
+   leaving the frame free for reuse.  Idle pages of the same
+   process that follow P go to swap with it, and their frames are
+   freed.  The owner's pages_lock must be held.  Returns false,
+   leaving P mapped, if swap is full. */
+bool
+page_evict (struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+  struct page *cluster[SWAP_CLUSTER];
+  const void *kpages[SWAP_CLUSTER];
+  size_t slot, cnt, i;
+
+  ASSERT (lock_held_by_current_thread (&p->owner->pages_lock));
+  ASSERT (p->frame->pin_cnt > 0);
+
+  /* Unmap first, so the owner cannot change the page while it is
+     being written. */
+  pagedir_clear_page (pd, p->upage);
+  if (p->mapped)
+    page_write_back (p);
+  if (p->mapped || (p->file != NULL && !pagedir_is_dirty (pd, p->upage)))
+    {
+      p->frame = NULL;
+      return true;
+    }
+
+  /* Find a run of free slots for as much of the cluster as
+     possible, giving up neighbours from the end. */
+  cnt = page_gather_evict (p, cluster);
+  while ((slot = swap_alloc (cnt)) == BITMAP_ERROR && cnt > 1)
+    frame_unpin (cluster[--cnt]->frame);
+  if (slot == BITMAP_ERROR)
+    {
+      pagedir_set_page (pd, p->upage, p->frame->kpage, p->writable);
+      pagedir_set_dirty (pd, p->upage, true);
+      return false;
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      if (i > 0)
+        pagedir_clear_page (pd, cluster[i]->upage);
+      kpages[i] = cluster[i]->frame->kpage;
+    }
+  swap_write (slot, kpages, cnt);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *q = cluster[i];
+
+      if (i > 0)
+        frame_free (q->frame);
+      q->swap_slot = slot + i;
+      q->file = NULL;
+      q->frame = NULL;
+    }
+  return true;
+}
+
+/* Puts P, a page of the running thread that is not in a frame,
+   into a newly allocated frame, filled from swap or its file,
+   and maps it.  The frame is left pinned.  Pages in the swap
+   slots after P's are read back with it into whatever free
+   frames there are.  Returns false if no frame is available or
+   the file is short.  The running thread's pages_lock must be
+   held. */
+static bool
+page_load (struct page *p)
+{
+  bool zero = p->swap_slot == BITMAP_ERROR && p->file == NULL;
+  struct frame *f;
+
+  ASSERT (p->frame == NULL);
+
+  f = frame_alloc (p, zero ? PAL_ZERO : 0);
+  if (f == NULL)
+    return false;
+
+  if (p->swap_slot != BITMAP_ERROR)
+    {
+      struct frame *frames[SWAP_CLUSTER];
+      void *kpages[SWAP_CLUSTER];
+      size_t cnt, i;
+
+      frames[0] = f;
+      cnt = page_gather_load (p, frames);
+      for (i = 0; i < cnt; i++)
+        kpages[i] = frames[i]->kpage;
+      swap_read (p->swap_slot, kpages, cnt);
+      swap_drop (p->swap_slot);
+      p->swap_slot = BITMAP_ERROR;
+
+      for (i = 1; i < cnt; i++)
+        {
+          struct page *q = frames[i]->page;
+
+          if (pagedir_set_page (p->owner->pagedir, q->upage,
+                                frames[i]->kpage, q->writable))
+            {
+              q->frame = frames[i];
+              swap_drop (q->swap_slot);
+              q->swap_slot = BITMAP_ERROR;
+              frame_unpin (q->frame);
+            }
+          else
+            frame_free (frames[i]);
+        }
+    }
+  else if (p->file != NULL)
+    {
+      if (file_read_at (p->file, f->kpage, p->read_bytes, p->file_ofs)
+          != (off_t) p->read_bytes)
+        {
+          frame_free (f);
+          return false;
+        }
+      memset ((uint8_t *) f->kpage + p->read_bytes, 0,
+              PGSIZE - p->read_bytes);
+    }
+
+  if (!pagedir_set_page (p->owner->pagedir, p->upage, f->kpage, p->writable))
+    {
+      frame_free (f);
+      return false;
+    }
+  p->frame = f;
+  return true;
+}
+
+/* Fills CLUSTER with P, which is being evicted to swap, followed
+   by the pages after it in its owner's address space that can go
+   to swap along with it: private pages in unpinned frames, not
+   accessed since the clock last cleared them, that cannot be read
+   back from a file.  Pins their frames and returns how many pages
+   CLUSTER holds, at most SWAP_CLUSTER. */
+static size_t
+page_gather_evict (struct page *p, struct page *cluster[])
+{
+  uint32_t *pd = p->owner->pagedir;
+  size_t cnt;
+
+  cluster[0] = p;
+  for (cnt = 1; cnt < SWAP_CLUSTER; cnt++)
+    {
+      void *upage = (uint8_t *) p->upage + cnt * PGSIZE;
+      struct page *q = page_lookup (p->owner, upage);
+
+      if (q == NULL || q->frame == NULL || q->share != NULL || q->mapped
+          || (q->file != NULL && !pagedir_is_dirty (pd, upage))
+          || pagedir_is_accessed (pd, upage)
+          || !frame_try_pin (q->frame))
+        break;
+      cluster[cnt] = q;
+    }
+  return cnt;
+}
+
+/* Given FRAMES[0], the frame P is being read into from swap,
+   fills the rest of FRAMES with free frames for the pages after
+   P in the running thread's address space that are not in memory
+   and sit in the swap slots after P's, stopping at the first page
+   for which there is none.  The frames are pinned and name their
+   pages.  Returns how many frames FRAMES holds, at most
+   SWAP_CLUSTER. */
+static size_t
+page_gather_load (struct page *p, struct frame *frames[])
+{
+  size_t cnt;
+
+  for (cnt = 1; cnt < SWAP_CLUSTER; cnt++)
+    {
+      void *upage = (uint8_t *) p->upage + cnt * PGSIZE;
+      struct page *q = page_lookup (p->owner, upage);
+
+      if (q == NULL || q->frame != NULL || q->share != NULL
+          || q->swap_slot != p->swap_slot + cnt)
+        break;
+      frames[cnt] = frame_try_alloc (q, 0);
+      if (frames[cnt] == NULL)
+        break;
+    }
+  return cnt;
+}
+
+/* Frees the page whose hash element is E, with whatever frame or
+   swap slot holds it. */
+static void
+page_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, elem);
+
+  if (p->share != NULL)
+    share_detach (p);
+  else if (p->frame != NULL)
+    {
+      if (p->mapped)
+        page_write_back (p);
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      frame_free (p->frame);
+    }
+  else if (p->swap_slot != BITMAP_ERROR)
+    swap_drop (p->swap_slot);
+  kmem_cache_free (&page_cache, p);
+}
+
+/* Writes P, a page of a mapped file that is in a frame, back to
+   its file if the process changed it.  Holding the owner's
+   pages_lock keeps the frame from being evicted meanwhile.
+
+   This may run in a page fault taken anywhere in the kernel, so
+   it relies only on the inode's own locking, never taking the
+   system calls' file system lock.  The inode never holds its
+   lock while touching memory that can fault, so the fault cannot
+   have interrupted a read or write of this same inode. */
+static void
+page_write_back (struct page *p)
+{
+  if (pagedir_is_dirty (p->owner->pagedir, p->upage))
+    file_write_at (p->file, p->frame->kpage, p->read_bytes, p->file_ofs);
+}
+
+/* Returns a hash of the page whose hash element is E. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+  return hash_ptr (p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  const struct page *pa = hash_entry (a, struct page, elem);
+  const struct page *pb = hash_entry (b, struct page, elem);
+  return pa->upage < pb->upage;
+}
@@ -0,0 +1,63 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+struct share;
+struct thread;
+
+/* A page of a process's virtual address space.
+
+   Each process keeps one of these for every user page it owns,
+   in its supplemental page table, recording where the page's
+   contents are while they are not in memory.  The page table is
+   guarded by its owner's pages_lock, which is also held by
+   whoever is evicting one of its pages. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    struct thread *owner;       /* Process whose page this is. */
+    bool writable;              /* Mapped read/write? */
+    struct frame *frame;        /* Frame holding the page, or null. */
+    size_t swap_slot;           /* Swap slot holding the page, or
+                                   BITMAP_ERROR if none. */
+    struct file *file;          /* File to read the page from, or null. */
+    off_t file_ofs;             /* Offset of the page's data in FILE. */
+    size_t read_bytes;          /* Bytes to read; the rest are zeroed. */
+    bool mapped;                /* Part of a mapped file, written back
+                                   to FILE when changed? */
+    struct share *share;        /* Shared copy mapped instead, or null. */
+    struct list_elem share_elem; /* Element in SHARE's page list. */
+    struct hash_elem elem;      /* Element in owner's page table. */
+  };
+
+/* -sl: Maximum number of pages in a process's stack. */
+extern size_t stack_page_limit;
+
+void page_init (void);
+bool page_table_init (void);
+void page_table_destroy (void);
+bool page_table_copy (struct thread *parent, struct file *parent_file,
+                      struct file *file);
+
+struct page *page_create (void *upage, bool writable);
+struct page *page_create_file (void *upage, bool writable, struct file *,
+                               off_t ofs, size_t read_bytes);
+struct page *page_create_mapped (void *upage, struct file *, off_t ofs,
+                                 size_t read_bytes);
+void page_remove (struct page *);
+struct page *page_lookup (struct thread *, const void *uaddr);
+void *page_pin (struct page *, bool write);
+void page_unpin (struct page *);
+bool page_fault_in (const void *fault_addr);
+bool page_grow_stack (const void *fault_addr, const void *esp);
+bool page_copy_on_write (const void *fault_addr);
+bool page_evict (struct page *);
+
+#endif /* vm/page.h */
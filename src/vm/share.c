@@ -0,0 +1,445 @@
+#include "vm/share.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <string.h>
+#include "devices/swap.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Shared pages.
+
+   Each shared file page is found in the share table by the file's
+   inode, the offset of its data and the number of bytes read.
+   Anonymous shared pages, made by share_copy() when a process
+   forks, are in no table.  Every shared page lists the process
+   pages that map it, and lives as long as any page maps it.  A
+   process maps the shared frame, read-only, the first time it
+   faults on the page; only the first of them to do so while the
+   page is not in memory reads it in.
+
+   share_lock guards the table, every shared page, and the page
+   table entries that map shared frames.  It is taken after a
+   process's pages_lock and before frame_lock.  The clock, which
+   holds frame_lock, only ever tries to take it. */
+
+static struct hash shares;              /* All shared pages. */
+static struct lock share_lock;          /* Guards shared pages. */
+
+/* True if share_select() took share_lock for the clock, so that
+   share_evict() should release it.  Guarded by share_lock. */
+static bool clock_locked;
+
+/* Cache of struct shares. */
+static struct kmem_cache share_cache;
+
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+static bool share_load (struct share *);
+
+/* Initializes the share table. */
+void
+share_init (void)
+{
+  hash_init (&shares, share_hash, share_less, NULL);
+  lock_init (&share_lock);
+  kmem_cache_init (&share_cache, "share", sizeof (struct share), NULL);
+}
+
+/* Makes P, a page not yet in memory, map the shared copy of the
+   READ_BYTES bytes of FILE at offset OFS, followed by zeros,
+   creating that copy if no other process maps it.  Returns false
+   if memory is short. */
+bool
+share_attach (struct page *p, struct file *file, off_t ofs,
+              size_t read_bytes)
+{
+  struct share key, *s;
+  struct hash_elem *e;
+
+  ASSERT (p->share == NULL && p->frame == NULL);
+
+  key.inode = file_get_inode (file);
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+
+  lock_acquire (&share_lock);
+  e = hash_find (&shares, &key.elem);
+  if (e != NULL)
+    s = hash_entry (e, struct share, elem);
+  else
+    {
+      s = kmem_cache_alloc (&share_cache);
+      if (s == NULL)
+        {
+          lock_release (&share_lock);
+          return false;
+        }
+      s->inode = inode_reopen (key.inode);
+      s->ofs = ofs;
+      s->read_bytes = read_bytes;
+      s->swap_slot = BITMAP_ERROR;
+      s->frame = NULL;
+      list_init (&s->pages);
+      hash_insert (&shares, &s->elem);
+    }
+  list_push_back (&s->pages, &p->share_elem);
+  p->share = s;
+  lock_release (&share_lock);
+  return true;
+}
+
+/* Makes COPY, a new page of the running thread with nothing in
+   it, share P's contents.  P is a page of the running thread's
+   parent, whose pages_lock the running thread holds.  Unless P
+   is already shared, its frame or swap slot becomes an anonymous
+   shared page, which P maps read-only from now on.  Returns
+   false if memory is short. */
+bool
+share_copy (struct page *p, struct page *copy)
+{
+  struct share *s;
+
+  ASSERT (lock_held_by_current_thread (&p->owner->pages_lock));
+  ASSERT (copy->share == NULL && copy->frame == NULL);
+
+  lock_acquire (&share_lock);
+  s = p->share;
+  if (s == NULL)
+    {
+      s = kmem_cache_alloc (&share_cache);
+      if (s == NULL)
+        {
+          lock_release (&share_lock);
+          return false;
+        }
+      s->inode = NULL;
+      s->ofs = 0;
+      s->read_bytes = 0;
+      s->swap_slot = p->swap_slot;
+      s->frame = p->frame;
+      list_init (&s->pages);
+      if (s->frame != NULL)
+        {
+          frame_assign (s->frame, NULL, s);
+          pagedir_set_writable (p->owner->pagedir, p->upage, false);
+        }
+
+      p->frame = NULL;
+      p->swap_slot = BITMAP_ERROR;
+      p->file = NULL;
+      list_push_back (&s->pages, &p->share_elem);
+      p->share = s;
+    }
+  list_push_back (&s->pages, &copy->share_elem);
+  copy->share = s;
+  lock_release (&share_lock);
+  return true;
+}
+
+/* Unmaps P from its shared page, freeing the shared page if no
+   other page maps it. */
+void
+share_detach (struct page *p)
+{
+  struct share *s = p->share;
+
+  lock_acquire (&share_lock);
+  if (s->frame != NULL)
+    pagedir_clear_page (p->owner->pagedir, p->upage);
+  list_remove (&p->share_elem);
+  p->share = NULL;
+
+  if (list_empty (&s->pages))
+    {
+      if (s->frame != NULL)
+        frame_free (s->frame);
+      else if (s->swap_slot != BITMAP_ERROR)
+        swap_drop (s->swap_slot);
+      if (s->inode != NULL)
+        {
+          hash_delete (&shares, &s->elem);
+          inode_close (s->inode);
+        }
+      kmem_cache_free (&share_cache, s);
+    }
+  lock_release (&share_lock);
+}
+
+/* Maps P, a page of the running thread that shares its contents,
+   to the shared frame, reading the shared page into one first if
+   no process has it in memory.  The running thread's pages_lock
+   must be held.  Returns false if no frame is available or the
+   file is short. */
+bool
+share_fault_in (struct page *p)
+{
+  struct share *s = p->share;
+  bool loaded = false;
+  bool success;
+
+  ASSERT (lock_held_by_current_thread (&p->owner->pages_lock));
+
+  lock_acquire (&share_lock);
+  if (s->frame == NULL)
+    {
+      if (!share_load (s))
+        {
+          lock_release (&share_lock);
+          return false;
+        }
+      loaded = true;
+    }
+  success = pagedir_set_page (p->owner->pagedir, p->upage, s->frame->kpage,
+                              false);
+  if (loaded)
+    frame_unpin (s->frame);
+  lock_release (&share_lock);
+  return success;
+}
+
+/* Maps P, a page of the running thread that shares its contents,
+   to the shared frame, as share_fault_in(), and keeps the frame
+   in memory until it is unpinned.  The running thread's
+   pages_lock must be held.  Returns the frame's kernel virtual
+   address, or a null pointer if no frame is available or the
+   file is short. */
+void *
+share_pin (struct page *p)
+{
+  struct share *s = p->share;
+  uint32_t *pd = p->owner->pagedir;
+  void *kpage = NULL;
+
+  ASSERT (lock_held_by_current_thread (&p->owner->pages_lock));
+
+  lock_acquire (&share_lock);
+  if (s->frame != NULL)
+    frame_pin (s->frame);
+  else if (!share_load (s))
+    goto done;
+
+  if (pagedir_get_page (pd, p->upage) == NULL
+      && !pagedir_set_page (pd, p->upage, s->frame->kpage, false))
+    frame_unpin (s->frame);
+  else
+    kpage = s->frame->kpage;
+
+ done:
+  lock_release (&share_lock);
+  return kpage;
+}
+
+/* Gives P, a writable page of the running thread that maps an
+   anonymous shared page, which the running thread just tried to
+   write, the shared page's contents for its own, mapped
+   read/write.  P takes the shared page over if no other page maps
+   it, and otherwise gets a copy.  The running thread's pages_lock
+   must be held.  Returns false, leaving P shared, if no frame is
+   available. */
+bool
+share_write (struct page *p)
+{
+  struct share *s = p->share;
+  uint32_t *pd = p->owner->pagedir;
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&p->owner->pages_lock));
+  ASSERT (s->inode == NULL && p->writable);
+
+  lock_acquire (&share_lock);
+
+  /* If S was unmapped from P since the fault, the write faults
+     again, and P maps S again first. */
+  if (s->frame == NULL || pagedir_get_page (pd, p->upage) == NULL)
+    {
+      lock_release (&share_lock);
+      return true;
+    }
+
+  if (list_front (&s->pages) == list_back (&s->pages))
+    {
+      /* No other page maps S any more, so P can have it. */
+      p->frame = s->frame;
+      frame_assign (p->frame, p, NULL);
+      list_remove (&p->share_elem);
+      p->share = NULL;
+      kmem_cache_free (&share_cache, s);
+      lock_release (&share_lock);
+
+      pagedir_set_writable (pd, p->upage, true);
+      return true;
+    }
+
+  /* Copy S, keeping it in memory meanwhile. */
+  frame_pin (s->frame);
+  f = frame_alloc (p, 0);
+  if (f != NULL)
+    {
+      memcpy (f->kpage, s->frame->kpage, PGSIZE);
+      pagedir_clear_page (pd, p->upage);
+      if (pagedir_set_page (pd, p->upage, f->kpage, true))
+        {
+          list_remove (&p->share_elem);
+          p->share = NULL;
+          p->frame = f;
+          frame_unpin (f);
+        }
+      else
+        {
+          frame_free (f);
+          f = NULL;
+        }
+    }
+  frame_unpin (s->frame);
+  lock_release (&share_lock);
+  return f != NULL;
+}
+
+/* Called by the clock, with frame_lock held, on S's unpinned
+   frame.  Gives S a second chance, clearing the accessed bits, if
+   any process used it since the clock last passed.  Otherwise
+   returns true with share_lock held, for share_evict() to evict
+   S.  Returns false if share_lock is busy. */
+bool
+share_select (struct share *s)
+{
+  bool accessed = false;
+  struct list_elem *e;
+
+  if (!lock_held_by_current_thread (&share_lock))
+    {
+      if (!lock_try_acquire (&share_lock))
+        return false;
+      clock_locked = true;
+    }
+
+  for (e = list_begin (&s->pages); e != list_end (&s->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, share_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          pagedir_set_accessed (pd, p->upage, false);
+          accessed = true;
+        }
+    }
+
+  if (accessed && clock_locked)
+    {
+      clock_locked = false;
+      lock_release (&share_lock);
+    }
+  return !accessed;
+}
+
+/* Unmaps S, chosen by share_select() and with its frame pinned
+   for eviction, from every process, leaving the frame free for
+   reuse.  A file page need not be written, since it can be read
+   again from its file; an anonymous page is written to swap.
+   Releases share_lock if share_select() took it.  Returns false,
+   leaving S mapped, if swap is full. */
+bool
+share_evict (struct share *s)
+{
+  struct list_elem *e;
+  bool success = true;
+
+  ASSERT (lock_held_by_current_thread (&share_lock));
+
+  /* No process can write S, so it can be written out before
+     being unmapped. */
+  if (s->inode == NULL)
+    {
+      s->swap_slot = swap_out (s->frame->kpage);
+      if (s->swap_slot == BITMAP_ERROR)
+        {
+          success = false;
+          goto done;
+        }
+    }
+
+  for (e = list_begin (&s->pages); e != list_end (&s->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, share_elem);
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+    }
+  s->frame = NULL;
+
+ done:
+  if (clock_locked)
+    {
+      clock_locked = false;
+      lock_release (&share_lock);
+    }
+  return success;
+}
+
+/* Reads S, from swap or its file, into a newly allocated frame,
+   which is left pinned.  Returns false if no frame is available
+   or the file is short.  share_lock must be held. */
+static bool
+share_load (struct share *s)
+{
+  struct frame *f;
+
+  ASSERT (s->frame == NULL);
+
+  f = frame_alloc (NULL, 0);
+  if (f == NULL)
+    return false;
+
+  if (s->inode == NULL)
+    {
+      ASSERT (s->swap_slot != BITMAP_ERROR);
+      swap_in (f->kpage, s->swap_slot);
+      s->swap_slot = BITMAP_ERROR;
+    }
+  else
+    {
+      if (inode_read_at (s->inode, f->kpage, s->read_bytes, s->ofs)
+          != (off_t) s->read_bytes)
+        {
+          frame_free (f);
+          return false;
+        }
+      memset ((uint8_t *) f->kpage + s->read_bytes, 0,
+              PGSIZE - s->read_bytes);
+    }
+
+  frame_assign (f, NULL, s);
+  s->frame = f;
+  return true;
+}
+
+/* Returns a hash of the shared page whose hash element is E. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct share *s = hash_entry (e, struct share, elem);
+  return hash_ptr (s->inode) ^ hash_int (s->ofs);
+}
+
+/* Returns true if shared page A precedes shared page B. */
+static bool
+share_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  const struct share *sa = hash_entry (a, struct share, elem);
+  const struct share *sb = hash_entry (b, struct share, elem);
+
+  if (sa->inode != sb->inode)
+    return sa->inode < sb->inode;
+  if (sa->ofs != sb->ofs)
+    return sa->ofs < sb->ofs;
+  return sa->read_bytes < sb->read_bytes;
+}
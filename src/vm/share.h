@@ -0,0 +1,56 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+struct inode;
+struct page;
+
+/* A page whose contents several processes' pages share.
+
+   A shared page is either a read-only page of a file, which
+   every process mapping the same file at the same offset shares,
+   or an anonymous page that fork() left copy-on-write between
+   parent and child.  Processes running the same executable all
+   map its code the first way, so it is read from disk and held
+   in memory once, however many of them there are.
+
+   Every process maps a shared page read-only, so its frame is
+   never written.  Evicting a file page just unmaps it from every
+   process and frees the frame; the next fault reads it in again.
+   An anonymous page is written to swap first.  A process that
+   writes to an anonymous page gets a private copy of it, or
+   takes it over if no other process still shares it.  All shared
+   pages are guarded by one lock in share.c. */
+struct share
+  {
+    struct inode *inode;        /* File the page is read from, or null
+                                   if anonymous. */
+    off_t ofs;                  /* Offset of the page's data. */
+    size_t read_bytes;          /* Bytes to read; the rest are zeroed. */
+    size_t swap_slot;           /* Swap slot holding an anonymous page,
+                                   or BITMAP_ERROR if none. */
+    struct frame *frame;        /* Frame holding the page, or null. */
+    struct list pages;          /* Pages mapping this page. */
+    struct hash_elem elem;      /* Element in the share table. */
+  };
+
+void share_init (void);
+bool share_attach (struct page *, struct file *, off_t ofs,
+                   size_t read_bytes);
+bool share_copy (struct page *, struct page *copy);
+void share_detach (struct page *);
+bool share_fault_in (struct page *);
+void *share_pin (struct page *);
+bool share_write (struct page *);
+
+bool share_select (struct share *);
+bool share_evict (struct share *);
+
+#endif /* vm/share.h */